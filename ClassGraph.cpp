@@ -0,0 +1,255 @@
+#include "ClassGraph.h"
+
+#include <algorithm>
+
+#include "llvm/ADT/SmallVector.h"
+
+#include "Report.h"
+#include "Stats.h"
+
+ClassGraph::Id ClassGraph::intern(llvm::StringRef S) const {
+  const auto Inserted = Ids.try_emplace(S, static_cast<Id>(Strings.size()));
+  if (Inserted.second)
+    Strings.push_back(Inserted.first->getKey());
+  return Inserted.first->second;
+}
+
+void ClassGraph::countRow(bool Inserted) const {
+  count(Inserted ? Counter::RowsInserted : Counter::RowsIgnored);
+}
+
+bool ClassGraph::insertClass(llvm::StringRef Name, llvm::StringRef Ns,
+                             llvm::StringRef File) const {
+  const auto Key = std::make_pair(intern(Name), intern(Ns));
+  const auto Inserted = ClassKeys.insert(Key).second;
+  if (Inserted)
+    Classes.push_back({Key.first, Key.second, intern(File)});
+  countRow(Inserted);
+  return true;
+}
+
+bool ClassGraph::insertTemplateInstance(llvm::StringRef Instance,
+                                        llvm::StringRef Tmpl,
+                                        llvm::StringRef TemplateArgs,
+                                        llvm::StringRef) const {
+  const auto Row =
+      TemplateInstance{intern(Instance), intern(Tmpl), intern(TemplateArgs)};
+  const auto Inserted =
+      InstanceKeys
+          .insert(std::make_tuple(Row.Instance, Row.Template, Row.TemplateArgs))
+          .second;
+  if (Inserted)
+    Instances.push_back(Row);
+  countRow(Inserted);
+  return true;
+}
+
+bool ClassGraph::insertMethod(llvm::StringRef Cls, llvm::StringRef Name,
+                              llvm::StringRef Returns,
+                              llvm::StringRef Parameters, int Access,
+                              bool IsStatic, bool IsAbstract,
+                              llvm::StringRef) const {
+  const auto Class = intern(Cls);
+  const auto Row = Method{intern(Name), intern(Returns), intern(Parameters),
+                          Access,       IsStatic,        IsAbstract};
+  const auto Inserted =
+      MethodKeys
+          .insert(std::make_tuple(Class, Row.Name, Row.Returns, Row.Parameters))
+          .second;
+  if (Inserted)
+    Methods[Class].push_back(Row);
+  countRow(Inserted);
+  return true;
+}
+
+bool ClassGraph::insertOwns(llvm::StringRef Owner, llvm::StringRef Object,
+                            llvm::StringRef Name, llvm::StringRef) const {
+  const auto Class = intern(Owner);
+  const auto Row = Field{intern(Object), intern(Name)};
+  const auto Inserted =
+      OwnsKeys.insert(std::make_tuple(Class, Row.Type, Row.Name)).second;
+  if (Inserted)
+    Owns[Class].push_back(Row);
+  countRow(Inserted);
+  return true;
+}
+
+bool ClassGraph::insertUses(llvm::StringRef User, llvm::StringRef Object,
+                            llvm::StringRef) const {
+  const auto Key = std::make_pair(intern(User), intern(Object));
+  const auto Inserted = UsesKeys.insert(Key).second;
+  if (Inserted)
+    Uses[Key.first].push_back(Key.second);
+  countRow(Inserted);
+  return true;
+}
+
+bool ClassGraph::insertInheritance(llvm::StringRef Derived,
+                                   llvm::StringRef Base,
+                                   llvm::StringRef) const {
+  const auto Key = std::make_pair(intern(Derived), intern(Base));
+  const auto Inserted = InheritanceKeys.insert(Key).second;
+  if (Inserted)
+    Inheritance.push_back(Key);
+  countRow(Inserted);
+  return true;
+}
+
+bool ClassGraph::insertCountedInstance(llvm::StringRef Tmpl,
+                                       llvm::StringRef Ns, int64_t Hash,
+                                       bool Collapsed) const {
+  auto &Instances = CountedInstances[std::make_pair(intern(Tmpl), intern(Ns))];
+  const auto Inserted = Instances.try_emplace(Hash, Collapsed);
+  Inserted.first->second = Inserted.first->second or Collapsed;
+  countRow(Inserted.second);
+  return true;
+}
+
+llvm::ArrayRef<ClassGraph::Method> ClassGraph::methods(Id Cls) const {
+  const auto It = Methods.find(Cls);
+  if (It == Methods.end())
+    return {};
+  return It->second;
+}
+
+llvm::ArrayRef<ClassGraph::Field> ClassGraph::owns(Id Cls) const {
+  const auto It = Owns.find(Cls);
+  if (It == Owns.end())
+    return {};
+  return It->second;
+}
+
+llvm::ArrayRef<ClassGraph::Id> ClassGraph::uses(Id Cls) const {
+  const auto It = Uses.find(Cls);
+  if (It == Uses.end())
+    return {};
+  return It->second;
+}
+
+int64_t ClassGraph::templateCount(Id Tmpl, Id Ns) const {
+  const auto It = CountedInstances.find(std::make_pair(Tmpl, Ns));
+  if (It == CountedInstances.end())
+    return 0;
+
+  for (const auto &Instance : It->second)
+    if (Instance.second)
+      return static_cast<int64_t>(It->second.size());
+  return 0;
+}
+
+bool ClassGraph::selected(const ReportKind &Kind, Id Cls) const {
+  return not Kind.scoped() or ReportScope.count(Cls) != 0;
+}
+
+bool ClassGraph::selectReport(const ReportKind &Kind) const {
+  ReportScope.clear();
+  if (not Kind.scoped())
+    return true;
+
+  // relations are followed in either direction
+  llvm::DenseMap<Id, llvm::SmallVector<Id, 4>> Neighbours;
+  const auto Connect = [&Neighbours](Id A, Id B) {
+    Neighbours[A].push_back(B);
+    Neighbours[B].push_back(A);
+  };
+  for (const auto &Edge : Inheritance)
+    Connect(Edge.first, Edge.second);
+  for (const auto &Entry : Owns)
+    for (const auto &Owned : Entry.second)
+      Connect(Entry.first, Owned.Type);
+  for (const auto &Entry : Uses)
+    for (const auto Used : Entry.second)
+      Connect(Entry.first, Used);
+  for (const auto &Instance : Instances)
+    Connect(Instance.Instance, Instance.Template);
+
+  // relations refer to classes by their unqualified name
+  std::vector<Id> Frontier;
+  for (const llvm::StringRef Root : Kind.Roots) {
+    const auto Name = Root.rsplit("::").second.empty()
+                          ? Root
+                          : Root.rsplit("::").second;
+    const auto It = Ids.find(Name);
+    if (It != Ids.end() and ReportScope.insert(It->second).second)
+      Frontier.push_back(It->second);
+  }
+
+  for (int Depth = 0; Depth < Kind.Depth and not Frontier.empty(); ++Depth) {
+    std::vector<Id> Next;
+    for (const auto Name : Frontier) {
+      const auto It = Neighbours.find(Name);
+      if (It == Neighbours.end())
+        continue;
+      for (const auto Neighbour : It->second)
+        if (ReportScope.insert(Neighbour).second)
+          Next.push_back(Neighbour);
+    }
+    Frontier = std::move(Next);
+  }
+
+  return true;
+}
+
+bool ClassGraph::visitClasses(const ReportKind &Kind,
+                              ReportVisitor &Visitor) const {
+  std::vector<const Class *> Sorted;
+  for (const auto &Cl : Classes)
+    if (selected(Kind, Cl.Name))
+      Sorted.push_back(&Cl);
+  std::sort(Sorted.begin(), Sorted.end(),
+            [this](const Class *A, const Class *B) {
+              return std::make_pair(text(A->Namespace), text(A->Name)) <
+                     std::make_pair(text(B->Namespace), text(B->Name));
+            });
+
+  for (const auto *const Cl : Sorted) {
+    Visitor.visitClass(text(Cl->Name), text(Cl->Namespace),
+                       templateCount(Cl->Name, Cl->Namespace));
+
+    if (Kind.DocumentMethods)
+      for (const auto &M : methods(Cl->Name))
+        Visitor.visitMethod(text(M.Name), text(M.Returns), text(M.Parameters),
+                            M.Access, M.IsStatic, M.IsAbstract);
+
+    if (Kind.DocumentOwns)
+      for (const auto &Owned : owns(Cl->Name))
+        if (selected(Kind, Owned.Type))
+          Visitor.visitOwns(text(Owned.Type), text(Owned.Name));
+
+    if (Kind.DocumentUses)
+      for (const auto Used : uses(Cl->Name))
+        if (selected(Kind, Used))
+          Visitor.visitUses(text(Used));
+  }
+  return true;
+}
+
+bool ClassGraph::visitTemplateInstances(const ReportKind &Kind,
+                                        ReportVisitor &Visitor) const {
+  std::vector<const TemplateInstance *> Sorted;
+  for (const auto &Instance : Instances)
+    if (selected(Kind, Instance.Instance))
+      Sorted.push_back(&Instance);
+  std::stable_sort(Sorted.begin(), Sorted.end(),
+                   [this](const TemplateInstance *A,
+                          const TemplateInstance *B) {
+                     return std::make_pair(text(A->Template),
+                                           text(A->TemplateArgs)) <
+                            std::make_pair(text(B->Template),
+                                           text(B->TemplateArgs));
+                   });
+
+  for (const auto *const Instance : Sorted)
+    Visitor.visitTemplateInstance(text(Instance->Instance),
+                                  text(Instance->Template),
+                                  text(Instance->TemplateArgs));
+  return true;
+}
+
+bool ClassGraph::visitInheritance(const ReportKind &Kind,
+                                  ReportVisitor &Visitor) const {
+  for (const auto &Edge : Inheritance)
+    if (selected(Kind, Edge.first) and selected(Kind, Edge.second))
+      Visitor.visitInheritance(text(Edge.first), text(Edge.second));
+  return true;
+}
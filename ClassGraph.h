@@ -0,0 +1,162 @@
+#ifndef CLASSGRAPH_H
+#define CLASSGRAPH_H
+
+#include <cstdint>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Allocator.h"
+
+#include "Storage.h"
+
+/// classes and their relations held in memory
+///
+/// All strings are interned into an arena once and rows refer to them by id;
+/// rows are deduplicated through hash sets and relations indexed by the name
+/// of the class they belong to, so recording a row is a few hash lookups and
+/// reports need no queries. Rows are kept in the order they were first
+/// inserted.
+///
+/// Used instead of a database for runs which do not persist their records.
+/// Not safe for concurrent use; the record writer is its only writer during
+/// extraction.
+class ClassGraph : public Storage {
+public:
+  /// an interned string
+  using Id = unsigned;
+
+  struct Class {
+    Id Name;
+    Id Namespace;
+    Id File;
+  };
+
+  struct Method {
+    Id Name;
+    Id Returns;
+    Id Parameters;
+    int Access;
+    bool IsStatic;
+    bool IsAbstract;
+  };
+
+  struct Field {
+    Id Type;
+    Id Name;
+  };
+
+  struct TemplateInstance {
+    Id Instance;
+    Id Template;
+    Id TemplateArgs;
+  };
+
+  ClassGraph() = default;
+  ClassGraph(const ClassGraph &) = delete;
+  ClassGraph &operator=(const ClassGraph &) = delete;
+
+  bool begin() const override { return true; }
+  bool commit() const override { return true; }
+
+  bool insertClass(llvm::StringRef Name, llvm::StringRef Ns,
+                   llvm::StringRef File) const override;
+
+  /// records are never removed, so relations are kept once for all files
+  /// defining a class of their name
+  /// @{
+  bool insertTemplateInstance(llvm::StringRef Instance, llvm::StringRef Tmpl,
+                              llvm::StringRef TemplateArgs,
+                              llvm::StringRef File) const override;
+  bool insertMethod(llvm::StringRef Cls, llvm::StringRef Name,
+                    llvm::StringRef Returns, llvm::StringRef Parameters,
+                    int Access, bool IsStatic, bool IsAbstract,
+                    llvm::StringRef File) const override;
+  bool insertOwns(llvm::StringRef Owner, llvm::StringRef Object,
+                  llvm::StringRef Name, llvm::StringRef File) const override;
+  bool insertUses(llvm::StringRef User, llvm::StringRef Object,
+                  llvm::StringRef File) const override;
+  bool insertInheritance(llvm::StringRef Derived, llvm::StringRef Base,
+                         llvm::StringRef File) const override;
+  /// @}
+
+  bool insertCountedInstance(llvm::StringRef Tmpl, llvm::StringRef Ns,
+                             int64_t Hash, bool Collapsed) const override;
+
+  /// translation units are only tracked in persistent storage
+  bool insertTranslationUnit(
+      llvm::StringRef, int64_t,
+      const std::vector<std::pair<std::string, int64_t>> &,
+      const TranslationUnitCost &) const override {
+    return true;
+  }
+
+  bool selectReport(const ReportKind &Kind) const override;
+  bool visitClasses(const ReportKind &Kind,
+                    ReportVisitor &Visitor) const override;
+  bool visitTemplateInstances(const ReportKind &Kind,
+                              ReportVisitor &Visitor) const override;
+  bool visitInheritance(const ReportKind &Kind,
+                        ReportVisitor &Visitor) const override;
+
+private:
+  /// the interned string with id @p I
+  llvm::StringRef text(Id I) const { return Strings[I]; }
+
+  /// the relations of the classes named @p Cls in insertion order
+  /// @{
+  llvm::ArrayRef<Method> methods(Id Cls) const;
+  llvm::ArrayRef<Field> owns(Id Cls) const;
+  llvm::ArrayRef<Id> uses(Id Cls) const;
+  /// @}
+
+  /// the number of instantiations counted for the template named @p Tmpl in
+  /// namespace @p Ns, or 0 if all were recorded as classes
+  int64_t templateCount(Id Tmpl, Id Ns) const;
+
+  /// look up or intern @p S
+  Id intern(llvm::StringRef S) const;
+
+  /// count an inserted or ignored row for `-stats`
+  void countRow(bool Inserted) const;
+
+  /// whether the class named @p Cls is in the report selected for @p Kind
+  bool selected(const ReportKind &Kind, Id Cls) const;
+
+  mutable llvm::StringMap<Id, llvm::BumpPtrAllocator> Ids;
+  mutable std::vector<llvm::StringRef> Strings;
+
+  mutable std::vector<Class> Classes;
+  mutable std::vector<TemplateInstance> Instances;
+  mutable std::vector<std::pair<Id, Id>> Inheritance;
+  mutable llvm::DenseMap<Id, std::vector<Method>> Methods;
+  mutable llvm::DenseMap<Id, std::vector<Field>> Owns;
+  mutable llvm::DenseMap<Id, std::vector<Id>> Uses;
+  /// the instantiations of templates by template name and namespace, keyed
+  /// by hash, with whether they were recorded as their template
+  mutable llvm::DenseMap<std::pair<Id, Id>, llvm::DenseMap<int64_t, bool>>
+      CountedInstances;
+
+  /// the keys of all rows, as in the unique indices of the database less
+  /// the file
+  /// @{
+  mutable llvm::DenseSet<std::pair<Id, Id>> ClassKeys;
+  mutable llvm::DenseSet<std::tuple<Id, Id, Id>> InstanceKeys;
+  mutable llvm::DenseSet<std::pair<Id, Id>> InheritanceKeys;
+  mutable llvm::DenseSet<std::tuple<Id, Id, Id, Id>> MethodKeys;
+  mutable llvm::DenseSet<std::tuple<Id, Id, Id>> OwnsKeys;
+  mutable llvm::DenseSet<std::pair<Id, Id>> UsesKeys;
+  /// @}
+
+  /// the names of the classes in the neighbourhood selected for a scoped
+  /// report
+  mutable llvm::DenseSet<Id> ReportScope;
+};
+
+#endif // CLASSGRAPH_H
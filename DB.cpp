@@ -1,89 +1,1116 @@
 #include "DB.h"
 
 #include <algorithm>
+#include <initializer_list>
 
+#include <llvm/ADT/DenseSet.h>
 #include <llvm/Support/raw_ostream.h>
 #include <sqlite3.h>
 
-DB::DB(const std::string &Dbpath) {
-  if (sqlite3_open(Dbpath.c_str(), &connection) != SQLITE_OK) {
+#include "Records.h"
+#include "Report.h"
+#include "Stats.h"
+
+namespace {
+bool bind(sqlite3_stmt *Stmt, int Index, llvm::StringRef Value) {
+  return sqlite3_bind_text(Stmt, Index, Value.data(), Value.size(),
+                           SQLITE_STATIC) == SQLITE_OK;
+}
+
+bool bind(sqlite3_stmt *Stmt, int Index, int64_t Value) {
+  return sqlite3_bind_int64(Stmt, Index, Value) == SQLITE_OK;
+}
+
+template <typename... Args>
+bool bindAll(sqlite3_stmt *Stmt, const Args &... Values) {
+  int Index = 0;
+  bool Ok = true;
+  // sqlite parameters are numbered from 1
+  (void)std::initializer_list<int>{(Ok = Ok and bind(Stmt, ++Index, Values),
+                                    0)...};
+  return Ok;
+}
+
+/// rows ordered by namespace and class name, consumed alongside the classes
+///
+/// The first two columns of the query must be the namespace and class name
+/// and rows must be ordered by them, just like the classes they are merged
+/// with. Disabled rows are never queried.
+class ClassRows {
+public:
+  ClassRows(bool Enabled, DB::Cursor Rows) : Rows(std::move(Rows)) {
+    Valid = Enabled and this->Rows.next();
+  }
+
+  /// whether the query could be prepared
+  bool valid() const { return Rows.valid(); }
+
+  /// skip all rows before the given class
+  ///
+  /// @returns whether the current row belongs to the class
+  bool at(llvm::StringRef Ns, llvm::StringRef Class) {
+    const auto Key = std::make_pair(Ns, Class);
+    while (Valid and std::make_pair(Rows.text(0), Rows.text(1)) < Key)
+      Valid = Rows.next();
+    return Valid and std::make_pair(Rows.text(0), Rows.text(1)) == Key;
+  }
+
+  void next() { Valid = Rows.next(); }
+
+  const DB::Cursor *operator->() const { return &Rows; }
+
+private:
+  DB::Cursor Rows;
+  bool Valid;
+};
+} // namespace
+
+DB::DB(const std::string &Dbpath) : DB(Dbpath, Options{}) {}
+
+DB::DB(const std::string &Dbpath, const Options &Opts) : options(Opts) {
+  const auto Flags = options.ReadOnly
+                         ? SQLITE_OPEN_READONLY
+                         : SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE;
+  if (sqlite3_open_v2(Dbpath.c_str(), &connection, Flags, nullptr) !=
+      SQLITE_OK) {
     llvm::errs() << "COULD NOT OPEN DB\n";
+    sqlite3_close(connection);
     connection = nullptr;
     return;
   }
 
-  if (not execute("CREATE TABLE IF NOT EXISTS classes ("
+  // the schema of a database only read is neither created nor converted
+  if (options.ReadOnly) {
+    if (not hasReadableSchema()) {
+      llvm::errs() << "UNSUPPORTED SCHEMA IN " << Dbpath
+                   << ", open it for writing once to convert it\n";
+      sqlite3_close(connection);
+      connection = nullptr;
+    }
+    return;
+  }
+
+  if (not options.JournalMode.empty() and
+      not execute("PRAGMA journal_mode = " + options.JournalMode))
+    llvm::errs() << "COULD NOT SET JOURNAL MODE " << options.JournalMode
+                 << "\n";
+  if (not options.Synchronous.empty() and
+      not execute("PRAGMA synchronous = " + options.Synchronous))
+    llvm::errs() << "COULD NOT SET SYNCHRONOUS " << options.Synchronous
+                 << "\n";
+
+  // databases from before names were interned are converted after the new
+  // tables exist
+  bool Legacy = false;
+  if (not renameLegacyTables(Legacy)) {
+    llvm::errs() << "COULD NOT MIGRATE DB\n";
+    connection = nullptr;
+    return;
+  }
+
+  if (not execute("CREATE TABLE IF NOT EXISTS names ("
                   "id INTEGER PRIMARY KEY,"
-                  "name TEXT NOT NULL,"
-                  "namespace TEXT);") or
+                  "name TEXT NOT NULL);") or
+      not execute("CREATE UNIQUE INDEX IF NOT EXISTS names_idx ON "
+                  "names(name)") or
+      not execute("CREATE TABLE IF NOT EXISTS files ("
+                  "id INTEGER PRIMARY KEY,"
+                  "path TEXT NOT NULL);") or
+      not execute("CREATE UNIQUE INDEX IF NOT EXISTS files_idx ON "
+                  "files(path)") or
+      not execute("CREATE TABLE IF NOT EXISTS translation_units ("
+                  "file INTEGER PRIMARY KEY REFERENCES files(id),"
+                  "command_hash INTEGER,"
+                  "memory INTEGER,"
+                  "milliseconds INTEGER);") or
+      not execute("CREATE TABLE IF NOT EXISTS dependencies ("
+                  "tu INTEGER REFERENCES files(id),"
+                  "file INTEGER REFERENCES files(id),"
+                  "hash INTEGER);") or
+      not execute("CREATE UNIQUE INDEX IF NOT EXISTS dependencies_idx ON "
+                  "dependencies(tu, file)") or
+      not execute("CREATE TABLE IF NOT EXISTS classes ("
+                  "id INTEGER PRIMARY KEY,"
+                  "name INTEGER NOT NULL REFERENCES names(id),"
+                  "namespace TEXT,"
+                  "file INTEGER REFERENCES files(id));") or
       not execute("CREATE UNIQUE INDEX IF NOT EXISTS classes_idx ON "
-                  "classes(name, namespace)") or
+                  "classes(name, namespace, IFNULL(file, 0))") or
       not execute("CREATE TABLE IF NOT EXISTS inheritance ("
-                  "derived INTEGER REFERENCES classes(id),"
-                  "base INTEGER REFERENCES classes(id));") or
+                  "derived INTEGER REFERENCES names(id),"
+                  "base INTEGER REFERENCES names(id),"
+                  "file INTEGER NOT NULL DEFAULT 0);") or
       not execute("CREATE UNIQUE INDEX IF NOT EXISTS inheritance_idx ON "
-                  "inheritance(derived, base)") or
+                  "inheritance(derived, base, file)") or
+      not execute("CREATE INDEX IF NOT EXISTS inheritance_base_idx ON "
+                  "inheritance(base)") or
       not execute("CREATE TABLE IF NOT EXISTS methods ("
-                  "class INTEGER REFERENCES classes(id),"
+                  "class INTEGER REFERENCES names(id),"
                   "name TEXT NOT NULL,"
-                  "returns TEXT,"
+                  "returns INTEGER REFERENCES names(id),"
                   "parameters TEXT,"
                   "access INTEGER,"
                   "static INTEGER,"
-                  "abstract INTEGER);") or
+                  "abstract INTEGER,"
+                  "file INTEGER NOT NULL DEFAULT 0);") or
       not execute("CREATE UNIQUE INDEX IF NOT EXISTS methods_idx ON "
-                  "methods(class, name, returns, parameters)") or
+                  "methods(class, name, returns, parameters, file)") or
       not execute("CREATE TABLE IF NOT EXISTS owns ("
-                  "owner INTEGER REFERENCES classes(id),"
-                  "object INTEGER REFERENCES classes(id),"
-                  "name TEXT NOT NULL);") or
+                  "owner INTEGER REFERENCES names(id),"
+                  "object INTEGER REFERENCES names(id),"
+                  "name TEXT NOT NULL,"
+                  "file INTEGER NOT NULL DEFAULT 0);") or
       not execute("CREATE UNIQUE INDEX IF NOT EXISTS owns_idx ON "
-                  "owns(owner, object, name)") or
+                  "owns(owner, object, name, file)") or
+      not execute("CREATE INDEX IF NOT EXISTS owns_object_idx ON "
+                  "owns(object)") or
       not execute("CREATE TABLE IF NOT EXISTS uses ("
-                  "user INTEGER REFERENCES classes(id),"
-                  "object INTEGER REFERENCES classes(id))") or
+                  "user INTEGER REFERENCES names(id),"
+                  "object INTEGER REFERENCES names(id),"
+                  "file INTEGER NOT NULL DEFAULT 0)") or
       not execute("CREATE UNIQUE INDEX IF NOT EXISTS uses_idx ON "
-                  "uses(user, object)") or
+                  "uses(user, object, file)") or
+      not execute("CREATE INDEX IF NOT EXISTS uses_object_idx ON "
+                  "uses(object)") or
       not execute("CREATE TABLE IF NOT EXISTS template_inst ("
-                  "instance INTEGER REFERENCES classes(id),"
-                  "template TEXT NOT NULL,"
-                  "template_args TEXT);") or
+                  "instance INTEGER REFERENCES names(id),"
+                  "template INTEGER REFERENCES names(id),"
+                  "template_args TEXT,"
+                  "file INTEGER NOT NULL DEFAULT 0);") or
       not execute("CREATE UNIQUE INDEX IF NOT EXISTS template_inst_idx ON "
-                  "template_inst(instance, template, template_args)"))
+                  "template_inst(instance, template, template_args, file)") or
+      not execute("CREATE INDEX IF NOT EXISTS template_inst_template_idx ON "
+                  "template_inst(template)") or
+      not execute("CREATE TABLE IF NOT EXISTS counted_instances ("
+                  "template INTEGER REFERENCES names(id),"
+                  "namespace TEXT NOT NULL,"
+                  "hash INTEGER,"
+                  "collapsed INTEGER);") or
+      not execute("CREATE UNIQUE INDEX IF NOT EXISTS counted_instances_idx ON "
+                  "counted_instances(template, namespace, hash)") or
+      not addMissingColumns() or not dropTemplateCounts() or
+      (Legacy and not migrateLegacyTables()))
     connection = nullptr;
 }
 
-DB::~DB() { sqlite3_close(connection); }
+bool DB::hasReadableSchema() const {
+  static const char *const Tables[] = {
+      "names", "classes", "inheritance", "methods", "owns", "uses",
+      "template_inst"};
+  for (const auto *const Table : Tables) {
+    bool Exists = false;
+    for (auto Columns = query(std::string("PRAGMA table_info(") + Table + ")");
+         Columns.next();)
+      Exists = true;
+    if (not Exists)
+      return false;
+  }
+
+  // the legacy schema stored class names as text
+  for (auto Columns = query("PRAGMA table_info(classes)"); Columns.next();)
+    if (Columns.text(1) == "name" and Columns.text(2) == "TEXT")
+      return false;
+  return true;
+}
+
+bool DB::addMissingColumns() const {
+  // the costs of translation units were added after they were first tracked
+  bool HasCost = false;
+  for (auto Columns = query("PRAGMA table_info(translation_units)");
+       Columns.next();)
+    HasCost = HasCost or Columns.text(1) == "memory";
+  if (not HasCost and
+      not (execute("ALTER TABLE translation_units ADD COLUMN memory "
+                   "INTEGER") and
+           execute("ALTER TABLE translation_units ADD COLUMN milliseconds "
+                   "INTEGER")))
+    return false;
+
+  // relations were first kept once per name, not per file defining their
+  // class; existing rows are attributed to a file defining a class of their
+  // name and their unique index is widened
+  struct Relation {
+    const char *Table;
+    const char *Class;
+    const char *Key;
+  };
+  static const Relation Relations[] = {
+      {"inheritance", "derived", "derived, base"},
+      {"methods", "class", "class, name, returns, parameters"},
+      {"owns", "owner", "owner, object, name"},
+      {"uses", "user", "user, object"},
+      {"template_inst", "instance", "instance, template, template_args"}};
+
+  for (const auto &R : Relations) {
+    bool HasFile = false;
+    for (auto Columns =
+             query(std::string("PRAGMA table_info(") + R.Table + ")");
+         Columns.next();)
+      HasFile = HasFile or Columns.text(1) == "file";
+    if (HasFile)
+      continue;
+
+    const std::string Table = R.Table;
+    const auto Widen = [&]() {
+      return execute("ALTER TABLE " + Table +
+                     " ADD COLUMN file INTEGER NOT NULL DEFAULT 0") and
+             execute("UPDATE " + Table +
+                     " SET file = IFNULL((SELECT min(c.file) FROM classes c "
+                     "WHERE c.name = " +
+                     Table + "." + R.Class + "), 0)") and
+             execute("DROP INDEX IF EXISTS " + Table + "_idx") and
+             execute("CREATE UNIQUE INDEX " + Table + "_idx ON " + Table +
+                     "(" + R.Key + ", file)");
+    };
+
+    if (not execute("BEGIN"))
+      return false;
+    if (not Widen()) {
+      execute("ROLLBACK");
+      return false;
+    }
+    if (not execute("COMMIT"))
+      return false;
+  }
+
+  // instantiations were first kept once, for the file of their template, not
+  // for every file instantiating them
+  bool Widened = false;
+  for (auto Rows = query("SELECT sql FROM sqlite_master WHERE type = 'index' "
+                         "AND name = 'classes_idx'");
+       Rows.next();)
+    Widened = Rows.text(0).contains("file");
+  return Widened or
+         (execute("DROP INDEX IF EXISTS classes_idx") and
+          execute("CREATE UNIQUE INDEX classes_idx ON "
+                  "classes(name, namespace, IFNULL(file, 0))"));
+}
+
+bool DB::dropTemplateCounts() const {
+  // counts of template instantiations were first kept as the largest count
+  // seen per unqualified template name; they can neither be told apart by
+  // namespace nor added up, so all translation units are parsed again to
+  // record the instantiations they see
+  bool Exists = false;
+  for (auto Rows = query("SELECT 1 FROM sqlite_master WHERE type = 'table' "
+                         "AND name = 'template_counts'");
+       Rows.next();)
+    Exists = true;
+  if (not Exists)
+    return true;
+
+  static const char *const Drop[] = {
+      "DELETE FROM dependencies WHERE EXISTS (SELECT 1 FROM template_counts)",
+      "DELETE FROM translation_units WHERE EXISTS (SELECT 1 FROM "
+      "template_counts)",
+      "DROP TABLE template_counts"};
+
+  if (not execute("BEGIN"))
+    return false;
+  for (const auto *const Statement : Drop)
+    if (not execute(Statement)) {
+      execute("ROLLBACK");
+      return false;
+    }
+  return execute("COMMIT");
+}
+
+bool DB::renameLegacyTables(bool &Renamed) const {
+  // the legacy schema stored class names as text in all tables
+  Renamed = false;
+  for (auto Columns = query("PRAGMA table_info(classes)"); Columns.next();)
+    Renamed = Renamed or (Columns.text(1) == "name" and
+                          Columns.text(2) == "TEXT");
+  if (not Renamed)
+    return true;
+
+  // databases written before files were tracked lack the origin of classes
+  bool HasFile = false;
+  for (auto Columns = query("PRAGMA table_info(classes)"); Columns.next();)
+    HasFile = HasFile or Columns.text(1) == "file";
+  if (not HasFile and
+      not execute("ALTER TABLE classes ADD COLUMN file INTEGER"))
+    return false;
+
+  static const char *const Tables[] = {"classes", "inheritance", "methods",
+                                       "owns",    "uses",        "template_inst"};
+
+  // indices keep their names when their table is renamed
+  std::vector<std::string> Indices;
+  for (auto Rows = query("SELECT name FROM sqlite_master WHERE type = 'index' "
+                         "AND sql IS NOT NULL");
+       Rows.next();)
+    Indices.push_back(Rows.text(0).str());
+
+  const auto Rename = [&]() {
+    for (const auto &Index : Indices)
+      if (Index != "files_idx" and Index != "dependencies_idx" and
+          not execute("DROP INDEX " + Index))
+        return false;
+    for (const auto *const Table : Tables)
+      if (not execute(std::string("ALTER TABLE ") + Table +
+                      " RENAME TO legacy_" + Table))
+        return false;
+    return true;
+  };
+
+  if (not execute("BEGIN"))
+    return false;
+  if (not Rename()) {
+    execute("ROLLBACK");
+    return false;
+  }
+  return execute("COMMIT");
+}
+
+bool DB::migrateLegacyTables() const {
+  static const char *const Migration[] = {
+      "INSERT OR IGNORE INTO names (name) "
+      "SELECT name FROM legacy_classes "
+      "UNION SELECT derived FROM legacy_inheritance "
+      "UNION SELECT base FROM legacy_inheritance "
+      "UNION SELECT class FROM legacy_methods "
+      "UNION SELECT returns FROM legacy_methods WHERE returns IS NOT NULL "
+      "UNION SELECT owner FROM legacy_owns "
+      "UNION SELECT object FROM legacy_owns "
+      "UNION SELECT user FROM legacy_uses "
+      "UNION SELECT object FROM legacy_uses "
+      "UNION SELECT instance FROM legacy_template_inst "
+      "UNION SELECT template FROM legacy_template_inst",
+      "INSERT OR IGNORE INTO classes (name, namespace, file) "
+      "SELECT n.id, c.namespace, c.file FROM legacy_classes c "
+      "JOIN names n ON n.name = c.name",
+      // relations are attributed to a file defining a class of their name
+      "INSERT OR IGNORE INTO inheritance (derived, base, file) "
+      "SELECT d.id, b.id, IFNULL((SELECT min(c.file) FROM classes c "
+      "WHERE c.name = d.id), 0) FROM legacy_inheritance i "
+      "JOIN names d ON d.name = i.derived JOIN names b ON b.name = i.base",
+      "INSERT OR IGNORE INTO methods (class, name, returns, parameters, "
+      "access, static, abstract, file) "
+      "SELECT c.id, m.name, r.id, m.parameters, m.access, m.static, "
+      "m.abstract, IFNULL((SELECT min(k.file) FROM classes k "
+      "WHERE k.name = c.id), 0) FROM legacy_methods m "
+      "JOIN names c ON c.name = m.class "
+      "LEFT JOIN names r ON r.name = m.returns",
+      "INSERT OR IGNORE INTO owns (owner, object, name, file) "
+      "SELECT o.id, b.id, w.name, IFNULL((SELECT min(c.file) FROM classes c "
+      "WHERE c.name = o.id), 0) FROM legacy_owns w "
+      "JOIN names o ON o.name = w.owner JOIN names b ON b.name = w.object",
+      "INSERT OR IGNORE INTO uses (user, object, file) "
+      "SELECT u.id, b.id, IFNULL((SELECT min(c.file) FROM classes c "
+      "WHERE c.name = u.id), 0) FROM legacy_uses s "
+      "JOIN names u ON u.name = s.user JOIN names b ON b.name = s.object",
+      "INSERT OR IGNORE INTO template_inst (instance, template, "
+      "template_args, file) "
+      "SELECT i.id, t.id, s.template_args, IFNULL((SELECT min(c.file) "
+      "FROM classes c WHERE c.name = i.id), 0) FROM legacy_template_inst s "
+      "JOIN names i ON i.name = s.instance JOIN names t ON t.name = s.template",
+      "DROP TABLE legacy_classes",
+      "DROP TABLE legacy_inheritance",
+      "DROP TABLE legacy_methods",
+      "DROP TABLE legacy_owns",
+      "DROP TABLE legacy_uses",
+      "DROP TABLE legacy_template_inst"};
+
+  if (not execute("BEGIN"))
+    return false;
+  for (const auto *const Statement : Migration)
+    if (not execute(Statement)) {
+      execute("ROLLBACK");
+      return false;
+    }
+  return execute("COMMIT");
+}
+
+bool DB::merge(const std::string &Path) const {
+  // ids differ between databases, so names and files are matched by value
+  // once and all other rows are translated through these maps
+  static const char *const Merge[] = {
+      "INSERT OR IGNORE INTO main.names (name) SELECT name FROM shard.names",
+      "INSERT OR IGNORE INTO main.files (path) SELECT path FROM shard.files",
+      "CREATE TEMP TABLE name_map (shard INTEGER PRIMARY KEY, id INTEGER)",
+      "INSERT INTO temp.name_map SELECT s.id, n.id FROM shard.names s "
+      "JOIN main.names n ON n.name = s.name",
+      "CREATE TEMP TABLE file_map (shard INTEGER PRIMARY KEY, id INTEGER)",
+      "INSERT INTO temp.file_map SELECT s.id, f.id FROM shard.files s "
+      "JOIN main.files f ON f.path = s.path",
+      "INSERT OR IGNORE INTO main.classes (name, namespace, file) "
+      "SELECT n.id, c.namespace, f.id FROM shard.classes c "
+      "JOIN temp.name_map n ON n.shard = c.name "
+      "LEFT JOIN temp.file_map f ON f.shard = c.file",
+      "INSERT OR IGNORE INTO main.inheritance (derived, base, file) "
+      "SELECT d.id, b.id, IFNULL(f.id, 0) FROM shard.inheritance i "
+      "JOIN temp.name_map d ON d.shard = i.derived "
+      "JOIN temp.name_map b ON b.shard = i.base "
+      "LEFT JOIN temp.file_map f ON f.shard = i.file",
+      "INSERT OR IGNORE INTO main.methods (class, name, returns, parameters, "
+      "access, static, abstract, file) "
+      "SELECT c.id, m.name, r.id, m.parameters, m.access, m.static, "
+      "m.abstract, IFNULL(f.id, 0) FROM shard.methods m "
+      "JOIN temp.name_map c ON c.shard = m.class "
+      "LEFT JOIN temp.name_map r ON r.shard = m.returns "
+      "LEFT JOIN temp.file_map f ON f.shard = m.file",
+      "INSERT OR IGNORE INTO main.owns (owner, object, name, file) "
+      "SELECT o.id, b.id, w.name, IFNULL(f.id, 0) FROM shard.owns w "
+      "JOIN temp.name_map o ON o.shard = w.owner "
+      "JOIN temp.name_map b ON b.shard = w.object "
+      "LEFT JOIN temp.file_map f ON f.shard = w.file",
+      "INSERT OR IGNORE INTO main.uses (user, object, file) "
+      "SELECT u.id, b.id, IFNULL(f.id, 0) FROM shard.uses s "
+      "JOIN temp.name_map u ON u.shard = s.user "
+      "JOIN temp.name_map b ON b.shard = s.object "
+      "LEFT JOIN temp.file_map f ON f.shard = s.file",
+      "INSERT OR IGNORE INTO main.template_inst (instance, template, "
+      "template_args, file) "
+      "SELECT i.id, t.id, s.template_args, IFNULL(f.id, 0) "
+      "FROM shard.template_inst s "
+      "JOIN temp.name_map i ON i.shard = s.instance "
+      "JOIN temp.name_map t ON t.shard = s.template "
+      "LEFT JOIN temp.file_map f ON f.shard = s.file",
+      // instantiations are counted as the union over all shards
+      "INSERT INTO main.counted_instances (template, namespace, hash, "
+      "collapsed) "
+      "SELECT t.id, c.namespace, c.hash, c.collapsed "
+      "FROM shard.counted_instances c "
+      "JOIN temp.name_map t ON t.shard = c.template WHERE 1 "
+      "ON CONFLICT(template, namespace, hash) DO UPDATE SET "
+      "collapsed = max(collapsed, excluded.collapsed)",
+      "DELETE FROM main.dependencies WHERE tu IN (SELECT f.id FROM "
+      "shard.translation_units t JOIN temp.file_map f ON f.shard = t.file)",
+      "INSERT OR REPLACE INTO main.translation_units (file, command_hash, "
+      "memory, milliseconds) "
+      "SELECT f.id, t.command_hash, t.memory, t.milliseconds "
+      "FROM shard.translation_units t "
+      "JOIN temp.file_map f ON f.shard = t.file",
+      "INSERT OR IGNORE INTO main.dependencies (tu, file, hash) "
+      "SELECT t.id, f.id, d.hash FROM shard.dependencies d "
+      "JOIN temp.file_map t ON t.shard = d.tu "
+      "JOIN temp.file_map f ON f.shard = d.file",
+      "DROP TABLE temp.name_map",
+      "DROP TABLE temp.file_map"};
+
+  char *const Attach =
+      sqlite3_mprintf("ATTACH DATABASE %Q AS shard", Path.c_str());
+  const auto Attached = execute(Attach);
+  sqlite3_free(Attach);
+  if (not Attached) {
+    llvm::errs() << "COULD NOT ATTACH " << Path << "\n";
+    return false;
+  }
+
+  const auto Copy = [&]() {
+    if (not execute("BEGIN"))
+      return false;
+    for (const auto *const Statement : Merge)
+      if (not execute(Statement)) {
+        execute("ROLLBACK");
+        return false;
+      }
+    return execute("COMMIT");
+  };
+
+  const auto Merged = Copy();
+  if (not Merged)
+    llvm::errs() << "COULD NOT MERGE " << Path << "\n";
+
+  return execute("DETACH DATABASE shard") and Merged;
+}
+
+bool DB::defineScope(const ReportKind &Kind) const {
+  if (not execute("DROP TABLE IF EXISTS temp.report_scope") or
+      not execute("CREATE TEMP TABLE report_scope (name INTEGER PRIMARY "
+                  "KEY)"))
+    return false;
+
+  // relations are followed breadth-first in both directions; every step is
+  // an indexed lookup, so the cost is proportional to the size of the
+  // neighbourhood, not of the database
+  auto Neighbours =
+      query("SELECT base FROM inheritance WHERE derived = ?1 "
+            "UNION SELECT derived FROM inheritance WHERE base = ?1 "
+            "UNION SELECT object FROM owns WHERE owner = ?1 "
+            "UNION SELECT owner FROM owns WHERE object = ?1 "
+            "UNION SELECT object FROM uses WHERE user = ?1 "
+            "UNION SELECT user FROM uses WHERE object = ?1 "
+            "UNION SELECT template FROM template_inst WHERE instance = ?1 "
+            "UNION SELECT instance FROM template_inst WHERE template = ?1");
+  auto Insert =
+      query("INSERT OR IGNORE INTO temp.report_scope (name) VALUES (?)");
+
+  // relations refer to classes by their unqualified name
+  auto Lookup = query("SELECT id FROM names WHERE name = ?");
+  llvm::DenseSet<int64_t> Seen;
+  std::vector<int64_t> Frontier;
+  for (const llvm::StringRef Root : Kind.Roots) {
+    const auto Name = Root.rsplit("::").second.empty()
+                          ? Root
+                          : Root.rsplit("::").second;
+    Lookup.reset();
+    Lookup.bind(1, Name);
+    if (Lookup.next() and Seen.insert(Lookup.integer(0)).second)
+      Frontier.push_back(Lookup.integer(0));
+  }
+
+  for (int Depth = 0; not Frontier.empty(); ++Depth) {
+    std::vector<int64_t> Next;
+    for (const auto Name : Frontier) {
+      Insert.reset();
+      Insert.bind(1, Name).next();
+
+      if (Depth == Kind.Depth)
+        continue;
+
+      Neighbours.reset();
+      Neighbours.bind(1, Name);
+      while (Neighbours.next()) {
+        if (Seen.insert(Neighbours.integer(0)).second)
+          Next.push_back(Neighbours.integer(0));
+      }
+    }
+    Frontier = std::move(Next);
+  }
+
+  return true;
+}
+
+std::string DB::inScope(const ReportKind &Kind, llvm::StringRef Column) {
+  return Kind.scoped() ? Column.str() + " IN temp.report_scope"
+                       : std::string("1");
+}
+
+bool DB::selectReport(const ReportKind &Kind) const {
+  return not Kind.scoped() or defineScope(Kind);
+}
+
+bool DB::visitClasses(const ReportKind &Kind, ReportVisitor &Visitor) const {
+  // relations are joined with their classes and ordered alike, so that a
+  // single pass over all queries visits each class with its relations;
+  // classes and rows recorded from several files are reported once, at their
+  // first position
+  auto Classes = query("SELECT COALESCE(c.namespace, ''), n.name, "
+                       "IFNULL(t.instances, 0) FROM classes c "
+                       "JOIN names n ON n.id = c.name "
+                       "LEFT JOIN (SELECT template, namespace, count(*) AS "
+                       "instances FROM counted_instances "
+                       "GROUP BY template, namespace HAVING max(collapsed)) t "
+                       "ON t.template = c.name "
+                       "AND t.namespace = COALESCE(c.namespace, '') WHERE " +
+                       inScope(Kind, "c.name") +
+                       " GROUP BY 1, c.name ORDER BY 1, 2");
+  auto Methods = ClassRows{
+      Kind.DocumentMethods,
+      query("SELECT COALESCE(c.namespace, ''), n.name, m.name, "
+            "IFNULL(r.name, ''), m.parameters, m.access, m.static, "
+            "m.abstract FROM classes c JOIN names n ON n.id = c.name "
+            "JOIN methods m ON m.class = c.name "
+            "LEFT JOIN names r ON r.id = m.returns WHERE " +
+            inScope(Kind, "c.name") +
+            " GROUP BY 1, c.name, m.name, m.returns, m.parameters "
+            "ORDER BY 1, 2, min(m.rowid)")};
+  auto Owns = ClassRows{
+      Kind.DocumentOwns,
+      query("SELECT COALESCE(c.namespace, ''), n.name, b.name, o.name "
+            "FROM classes c JOIN names n ON n.id = c.name "
+            "JOIN owns o ON o.owner = c.name "
+            "JOIN names b ON b.id = o.object WHERE " +
+            inScope(Kind, "c.name") + " AND " + inScope(Kind, "o.object") +
+            " GROUP BY 1, c.name, o.object, o.name "
+            "ORDER BY 1, 2, min(o.rowid)")};
+  auto Uses = ClassRows{
+      Kind.DocumentUses,
+      query("SELECT COALESCE(c.namespace, ''), n.name, b.name "
+            "FROM classes c JOIN names n ON n.id = c.name "
+            "JOIN uses u ON u.user = c.name "
+            "JOIN names b ON b.id = u.object WHERE " +
+            inScope(Kind, "c.name") + " AND " + inScope(Kind, "u.object") +
+            " GROUP BY 1, c.name, u.object ORDER BY 1, 2, min(u.rowid)")};
+  if (not Classes.valid() or not Methods.valid() or not Owns.valid() or
+      not Uses.valid())
+    return false;
+
+  while (Classes.next()) {
+    const auto Ns = Classes.text(0);
+    const auto Class = Classes.text(1);
+    Visitor.visitClass(Class, Ns, Classes.integer(2));
+
+    for (; Methods.at(Ns, Class); Methods.next())
+      Visitor.visitMethod(Methods->text(2), Methods->text(3), Methods->text(4),
+                          Methods->integer(5), Methods->integer(6),
+                          Methods->integer(7));
+    for (; Owns.at(Ns, Class); Owns.next())
+      Visitor.visitOwns(Owns->text(2), Owns->text(3));
+    for (; Uses.at(Ns, Class); Uses.next())
+      Visitor.visitUses(Uses->text(2));
+  }
+  return true;
+}
+
+bool DB::visitTemplateInstances(const ReportKind &Kind,
+                                ReportVisitor &Visitor) const {
+  auto Rows = query("SELECT i.name, t.name, s.template_args "
+                    "FROM template_inst s "
+                    "JOIN names i ON i.id = s.instance "
+                    "JOIN names t ON t.id = s.template WHERE " +
+                    inScope(Kind, "s.instance") +
+                    " GROUP BY s.instance, s.template, s.template_args "
+                    "ORDER BY 2, 3, min(s.rowid)");
+  while (Rows.next())
+    Visitor.visitTemplateInstance(Rows.text(0), Rows.text(1), Rows.text(2));
+  return Rows.valid();
+}
+
+bool DB::visitInheritance(const ReportKind &Kind,
+                          ReportVisitor &Visitor) const {
+  auto Rows = query("SELECT d.name, b.name FROM inheritance i "
+                    "JOIN names d ON d.id = i.derived "
+                    "JOIN names b ON b.id = i.base WHERE " +
+                    inScope(Kind, "i.derived") + " AND " +
+                    inScope(Kind, "i.base") +
+                    " GROUP BY i.derived, i.base ORDER BY min(i.rowid)");
+  while (Rows.next())
+    Visitor.visitInheritance(Rows.text(0), Rows.text(1));
+  return Rows.valid();
+}
+
+DB::~DB() {
+  for (auto &Entry : statements)
+    sqlite3_finalize(Entry.second);
+  sqlite3_close(connection);
+}
 
 bool DB::execute(const std::string &Statement) const {
-  if (sqlite3_prepare_v2(connection, Statement.c_str(), -1, &stmt, nullptr) !=
+  std::lock_guard<std::mutex> Lock(mutex);
+
+  sqlite3_stmt *Stmt = nullptr;
+  if (sqlite3_prepare_v2(connection, Statement.c_str(), -1, &Stmt, nullptr) !=
       SQLITE_OK) {
     llvm::errs() << "COULD NOT PREPARE " << Statement << "\n";
     llvm::errs() << sqlite3_errmsg(connection) << "\n";
     return false;
   }
 
-  rows.clear();
-  step();
+  count(Counter::Queries);
+  auto Rc = sqlite3_step(Stmt);
+  while (Rc == SQLITE_ROW)
+    Rc = sqlite3_step(Stmt);
+  sqlite3_finalize(Stmt);
 
-  return true;
+  return Rc == SQLITE_DONE;
 }
 
-bool DB::step() const {
-  const auto Rc = sqlite3_step(stmt);
-  if (Rc == SQLITE_DONE) {
-    return true;
+DB::Cursor DB::query(llvm::StringRef Sql) const {
+  sqlite3_stmt *Stmt = nullptr;
+  if (sqlite3_prepare_v2(connection, Sql.data(), Sql.size(), &Stmt,
+                         nullptr) != SQLITE_OK) {
+    llvm::errs() << "COULD NOT PREPARE " << Sql << "\n";
+    llvm::errs() << sqlite3_errmsg(connection) << "\n";
+    sqlite3_finalize(Stmt);
+    Stmt = nullptr;
   }
 
-  if (Rc == SQLITE_ROW) {
-    std::vector<std::string> Result;
-    for (int Column = 0; Column < sqlite3_column_count(stmt); ++Column) {
-      Result.emplace_back(
-          reinterpret_cast<const char *>(sqlite3_column_text(stmt, Column)));
-    }
-    rows.emplace_back(std::move(Result));
-    return step();
+  count(Counter::Queries);
+  return Cursor(Stmt, connection);
+}
+
+DB::Cursor::Cursor(sqlite3_stmt *Statement, sqlite3 *Connection)
+    : statement(Statement), connection(Connection) {}
+
+DB::Cursor::Cursor(Cursor &&Other)
+    : statement(Other.statement), connection(Other.connection),
+      done(Other.done) {
+  Other.statement = nullptr;
+}
+
+DB::Cursor::~Cursor() { sqlite3_finalize(statement); }
+
+DB::Cursor &DB::Cursor::bind(int Index, llvm::StringRef Value) {
+  if (statement)
+    sqlite3_bind_text(statement, Index, Value.data(), Value.size(),
+                      SQLITE_TRANSIENT);
+  return *this;
+}
+
+DB::Cursor &DB::Cursor::bind(int Index, int64_t Value) {
+  if (statement)
+    sqlite3_bind_int64(statement, Index, Value);
+  return *this;
+}
+
+bool DB::Cursor::next() {
+  // do not step a finished statement again
+  if (not statement or done)
+    return false;
+
+  const auto Rc = sqlite3_step(statement);
+  if (Rc == SQLITE_ROW)
+    return true;
+
+  if (Rc != SQLITE_DONE) {
+    llvm::errs() << "COULD NOT EXECUTE " << sqlite3_sql(statement) << "\n";
+    llvm::errs() << sqlite3_errmsg(connection) << "\n";
   }
 
+  done = true;
   return false;
 }
+
+void DB::Cursor::reset() {
+  if (statement)
+    sqlite3_reset(statement);
+  done = false;
+  count(Counter::Queries);
+}
+
+llvm::StringRef DB::Cursor::text(int Column) const {
+  const auto *const Text =
+      reinterpret_cast<const char *>(sqlite3_column_text(statement, Column));
+  if (not Text)
+    return {};
+  return {Text, static_cast<size_t>(sqlite3_column_bytes(statement, Column))};
+}
+
+int64_t DB::Cursor::integer(int Column) const {
+  return sqlite3_column_int64(statement, Column);
+}
+
+bool DB::Cursor::isNull(int Column) const {
+  return sqlite3_column_type(statement, Column) == SQLITE_NULL;
+}
+
+bool DB::begin() const {
+  std::lock_guard<std::mutex> Lock(mutex);
+
+  if (inTransaction)
+    return true;
+  inTransaction = run("BEGIN");
+  pendingRows = 0;
+  return inTransaction;
+}
+
+bool DB::commit() const {
+  std::lock_guard<std::mutex> Lock(mutex);
+
+  if (not inTransaction)
+    return true;
+  inTransaction = false;
+  return run("COMMIT");
+}
+
+bool DB::insertClass(llvm::StringRef Name, llvm::StringRef Ns,
+                     llvm::StringRef File) const {
+  std::lock_guard<std::mutex> Lock(mutex);
+  const auto NameId = nameId(Name);
+  const auto FileId = fileId(File);
+  auto *const Stmt = prepare("INSERT OR IGNORE INTO classes (name, namespace, "
+                             "file) VALUES (?, ?, ?)");
+  if (not NameId or not Stmt or not bindAll(Stmt, *NameId, Ns))
+    return false;
+  if (FileId)
+    sqlite3_bind_int64(Stmt, 3, *FileId);
+  return insert(Stmt, /*CountRow=*/true);
+}
+
+bool DB::insertTemplateInstance(llvm::StringRef Instance,
+                                llvm::StringRef Tmpl,
+                                llvm::StringRef TemplateArgs,
+                                llvm::StringRef File) const {
+  std::lock_guard<std::mutex> Lock(mutex);
+  const auto InstanceId = nameId(Instance);
+  const auto TemplateId = nameId(Tmpl);
+  auto *const Stmt =
+      prepare("INSERT OR IGNORE INTO template_inst (instance, template, "
+              "template_args, file) VALUES (?, ?, ?, ?)");
+  return InstanceId and TemplateId and Stmt and
+         bindAll(Stmt, *InstanceId, *TemplateId, TemplateArgs,
+                 relationFile(File)) and
+         insert(Stmt, /*CountRow=*/true);
+}
+
+bool DB::insertMethod(llvm::StringRef Cls, llvm::StringRef Name,
+                      llvm::StringRef Returns, llvm::StringRef Parameters,
+                      int Access, bool IsStatic, bool IsAbstract,
+                      llvm::StringRef File) const {
+  std::lock_guard<std::mutex> Lock(mutex);
+  const auto ClassId = nameId(Cls);
+  const auto ReturnsId = nameId(Returns);
+  auto *const Stmt =
+      prepare("INSERT OR IGNORE INTO methods (class, name, returns, "
+              "parameters, access, static, abstract, file) VALUES (?, ?, ?, "
+              "?, ?, ?, ?, ?)");
+  return ClassId and ReturnsId and Stmt and
+         bindAll(Stmt, *ClassId, Name, *ReturnsId, Parameters,
+                 int64_t{Access}, int64_t{IsStatic}, int64_t{IsAbstract},
+                 relationFile(File)) and
+         insert(Stmt, /*CountRow=*/true);
+}
+
+bool DB::insertOwns(llvm::StringRef Owner, llvm::StringRef Object,
+                    llvm::StringRef Name, llvm::StringRef File) const {
+  std::lock_guard<std::mutex> Lock(mutex);
+  const auto OwnerId = nameId(Owner);
+  const auto ObjectId = nameId(Object);
+  auto *const Stmt = prepare("INSERT OR IGNORE INTO owns (owner, object, "
+                             "name, file) VALUES (?, ?, ?, ?)");
+  return OwnerId and ObjectId and Stmt and
+         bindAll(Stmt, *OwnerId, *ObjectId, Name, relationFile(File)) and
+         insert(Stmt, /*CountRow=*/true);
+}
+
+bool DB::insertUses(llvm::StringRef User, llvm::StringRef Object,
+                    llvm::StringRef File) const {
+  std::lock_guard<std::mutex> Lock(mutex);
+  const auto UserId = nameId(User);
+  const auto ObjectId = nameId(Object);
+  auto *const Stmt = prepare(
+      "INSERT OR IGNORE INTO uses (user, object, file) VALUES (?, ?, ?)");
+  return UserId and ObjectId and Stmt and
+         bindAll(Stmt, *UserId, *ObjectId, relationFile(File)) and
+         insert(Stmt, /*CountRow=*/true);
+}
+
+bool DB::insertInheritance(llvm::StringRef Derived, llvm::StringRef Base,
+                           llvm::StringRef File) const {
+  std::lock_guard<std::mutex> Lock(mutex);
+  const auto DerivedId = nameId(Derived);
+  const auto BaseId = nameId(Base);
+  auto *const Stmt = prepare("INSERT OR IGNORE INTO inheritance (derived, "
+                             "base, file) VALUES (?, ?, ?)");
+  return DerivedId and BaseId and Stmt and
+         bindAll(Stmt, *DerivedId, *BaseId, relationFile(File)) and
+         insert(Stmt, /*CountRow=*/true);
+}
+
+bool DB::insertCountedInstance(llvm::StringRef Tmpl, llvm::StringRef Ns,
+                               int64_t Hash, bool Collapsed) const {
+  std::lock_guard<std::mutex> Lock(mutex);
+
+  const auto TemplateId = nameId(Tmpl);
+  auto *const Stmt = prepare(
+      "INSERT INTO counted_instances (template, namespace, hash, collapsed) "
+      "VALUES (?, IFNULL(?, ''), ?, ?) "
+      "ON CONFLICT(template, namespace, hash) DO UPDATE SET "
+      "collapsed = max(collapsed, excluded.collapsed)");
+  return TemplateId and Stmt and
+         bindAll(Stmt, *TemplateId, Ns, Hash, int64_t{Collapsed}) and
+         insert(Stmt, /*CountRow=*/true);
+}
+
+bool DB::insertTranslationUnit(
+    llvm::StringRef Path, int64_t CommandHash,
+    const std::vector<std::pair<std::string, int64_t>> &Dependencies,
+    const TranslationUnitCost &Cost) const {
+  std::lock_guard<std::mutex> Lock(mutex);
+
+  const auto TuId = fileId(Path);
+  if (not TuId)
+    return false;
+
+  auto *const Unit =
+      prepare("INSERT OR REPLACE INTO translation_units "
+              "(file, command_hash, memory, milliseconds) VALUES (?, ?, ?, ?)");
+  auto *const Clear = prepare("DELETE FROM dependencies WHERE tu = ?");
+  if (not Unit or
+      not bindAll(Unit, *TuId, CommandHash, Cost.Memory, Cost.Milliseconds) or
+      not insert(Unit) or not Clear or not bindAll(Clear, *TuId) or
+      not insert(Clear))
+    return false;
+
+  for (const auto &Dependency : Dependencies) {
+    const auto Id = fileId(Dependency.first);
+    auto *const Stmt = prepare("INSERT OR IGNORE INTO dependencies (tu, file, "
+                               "hash) VALUES (?, ?, ?)");
+    if (not Id or not Stmt or
+        not bindAll(Stmt, *TuId, *Id, Dependency.second) or not insert(Stmt))
+      return false;
+  }
+
+  return true;
+}
+
+bool DB::lookupTranslationUnit(
+    llvm::StringRef Path, int64_t &CommandHash,
+    std::vector<std::pair<std::string, int64_t>> &Dependencies) const {
+  std::lock_guard<std::mutex> Lock(mutex);
+
+  auto *const Unit =
+      prepare("SELECT t.file, t.command_hash FROM translation_units t "
+              "JOIN files f ON f.id = t.file WHERE f.path = ?");
+  if (not Unit or not bindAll(Unit, Path))
+    return false;
+
+  const auto Found = sqlite3_step(Unit) == SQLITE_ROW;
+  const auto TuId = Found ? sqlite3_column_int64(Unit, 0) : 0;
+  CommandHash = Found ? sqlite3_column_int64(Unit, 1) : 0;
+  sqlite3_reset(Unit);
+  sqlite3_clear_bindings(Unit);
+  if (not Found)
+    return false;
+
+  auto *const Deps = prepare("SELECT f.path, d.hash FROM dependencies d "
+                             "JOIN files f ON f.id = d.file WHERE d.tu = ?");
+  if (not Deps or not bindAll(Deps, TuId))
+    return false;
+
+  Dependencies.clear();
+  while (sqlite3_step(Deps) == SQLITE_ROW) {
+    Dependencies.emplace_back(
+        reinterpret_cast<const char *>(sqlite3_column_text(Deps, 0)),
+        sqlite3_column_int64(Deps, 1));
+  }
+  sqlite3_reset(Deps);
+  sqlite3_clear_bindings(Deps);
+
+  return true;
+}
+
+bool DB::lookupTranslationUnitCosts(
+    llvm::StringMap<TranslationUnitCost> &Costs) const {
+  std::lock_guard<std::mutex> Lock(mutex);
+
+  auto *const Units =
+      prepare("SELECT f.path, t.memory, t.milliseconds FROM translation_units "
+              "t JOIN files f ON f.id = t.file WHERE t.memory IS NOT NULL");
+  if (not Units)
+    return false;
+
+  Costs.clear();
+  while (sqlite3_step(Units) == SQLITE_ROW) {
+    auto &Cost = Costs[reinterpret_cast<const char *>(
+        sqlite3_column_text(Units, 0))];
+    Cost.Memory = sqlite3_column_int64(Units, 1);
+    Cost.Milliseconds = sqlite3_column_int64(Units, 2);
+  }
+  sqlite3_reset(Units);
+
+  return true;
+}
+
+bool DB::removeRecordsFromFile(llvm::StringRef Path) const {
+  std::lock_guard<std::mutex> Lock(mutex);
+
+  // rows of the edge tables carry the file defining the class they were
+  // recorded for, so the rows of classes of the same name defined elsewhere
+  // are kept
+  static const char *const Deletes[] = {
+      "DELETE FROM methods WHERE file IN (SELECT id FROM files WHERE path = "
+      "?)",
+      "DELETE FROM owns WHERE file IN (SELECT id FROM files WHERE path = ?)",
+      "DELETE FROM uses WHERE file IN (SELECT id FROM files WHERE path = ?)",
+      "DELETE FROM inheritance WHERE file IN (SELECT id FROM files WHERE "
+      "path = ?)",
+      "DELETE FROM template_inst WHERE file IN (SELECT id FROM files WHERE "
+      "path = ?)",
+      "DELETE FROM classes WHERE file IN (SELECT id FROM files WHERE path = "
+      "?)"};
+
+  for (const auto *const Sql : Deletes) {
+    auto *const Stmt = prepare(Sql);
+    if (not Stmt or not bindAll(Stmt, Path) or not insert(Stmt))
+      return false;
+  }
+
+  return true;
+}
+
+std::optional<int64_t> DB::nameId(llvm::StringRef Name) const {
+  const auto Cached = nameIds.find(Name);
+  if (Cached != nameIds.end())
+    return Cached->second;
+
+  auto *const Insert =
+      prepare("INSERT OR IGNORE INTO names (name) VALUES (?)");
+  auto *const Select = prepare("SELECT id FROM names WHERE name = ?");
+  if (not Insert or not Select or not bindAll(Insert, Name) or
+      not insert(Insert) or not bindAll(Select, Name))
+    return std::nullopt;
+
+  std::optional<int64_t> Id;
+  if (sqlite3_step(Select) == SQLITE_ROW)
+    Id = sqlite3_column_int64(Select, 0);
+  sqlite3_reset(Select);
+  sqlite3_clear_bindings(Select);
+
+  if (Id)
+    nameIds[Name] = *Id;
+  return Id;
+}
+
+std::optional<int64_t> DB::fileId(llvm::StringRef Path) const {
+  if (Path.empty())
+    return std::nullopt;
+
+  const auto Cached = fileIds.find(Path);
+  if (Cached != fileIds.end())
+    return Cached->second;
+
+  auto *const Insert =
+      prepare("INSERT OR IGNORE INTO files (path) VALUES (?)");
+  auto *const Select = prepare("SELECT id FROM files WHERE path = ?");
+  if (not Insert or not Select or not bindAll(Insert, Path) or
+      not insert(Insert) or not bindAll(Select, Path))
+    return std::nullopt;
+
+  std::optional<int64_t> Id;
+  if (sqlite3_step(Select) == SQLITE_ROW)
+    Id = sqlite3_column_int64(Select, 0);
+  sqlite3_reset(Select);
+  sqlite3_clear_bindings(Select);
+
+  if (Id)
+    fileIds[Path] = *Id;
+  return Id;
+}
+
+int64_t DB::relationFile(llvm::StringRef Path) const {
+  return fileId(Path).value_or(0);
+}
+
+sqlite3_stmt *DB::prepare(llvm::StringRef Sql) const {
+  auto &Cached = statements[Sql];
+  if (Cached)
+    return Cached;
+
+  if (sqlite3_prepare_v2(connection, Sql.data(), Sql.size(), &Cached,
+                         nullptr) != SQLITE_OK) {
+    llvm::errs() << "COULD NOT PREPARE " << Sql << "\n";
+    llvm::errs() << sqlite3_errmsg(connection) << "\n";
+    statements.erase(Sql);
+    return nullptr;
+  }
+
+  return Cached;
+}
+
+bool DB::insert(sqlite3_stmt *Statement, bool CountRow) const {
+  const auto Rc = sqlite3_step(Statement);
+  sqlite3_reset(Statement);
+  sqlite3_clear_bindings(Statement);
+
+  if (Rc != SQLITE_DONE) {
+    llvm::errs() << "COULD NOT EXECUTE " << sqlite3_sql(Statement) << "\n";
+    llvm::errs() << sqlite3_errmsg(connection) << "\n";
+    return false;
+  }
+
+  if (CountRow)
+    count(sqlite3_changes(connection) ? Counter::RowsInserted
+                                      : Counter::RowsIgnored);
+
+  if (inTransaction and ++pendingRows >= options.BatchSize) {
+    pendingRows = 0;
+    return run("COMMIT") and run("BEGIN");
+  }
+
+  return true;
+}
+
+bool DB::run(const char *Sql) const {
+  char *Error = nullptr;
+  if (sqlite3_exec(connection, Sql, nullptr, nullptr, &Error) != SQLITE_OK) {
+    llvm::errs() << "COULD NOT EXECUTE " << Sql << "\n";
+    llvm::errs() << Error << "\n";
+    sqlite3_free(Error);
+    return false;
+  }
+  return true;
+}
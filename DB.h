@@ -1,28 +1,250 @@
 #ifndef DB_H
 #define DB_H
 
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <optional>
 #include <string>
+#include <utility>
 #include <vector>
 
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Allocator.h"
+
+#include "Storage.h"
+
 struct sqlite3_stmt;
 struct sqlite3;
 
-class DB {
+/// storage of records in a sqlite database, persisting them across runs
+class DB : public Storage {
 public:
+  /// tuning knobs for the underlying sqlite connection
+  struct Options {
+    /// value for `PRAGMA journal_mode`, e.g. `wal`; empty keeps the default
+    std::string JournalMode;
+    /// value for `PRAGMA synchronous`, e.g. `off`; empty keeps the default
+    std::string Synchronous;
+    /// number of inserted rows after which an open transaction is committed
+    size_t BatchSize = 10000;
+    /// open an existing database for queries only, without creating or
+    /// converting its schema; fails unless its tables can be queried as is
+    bool ReadOnly = false;
+  };
+
   explicit DB(const std::string &dbpath);
+  DB(const std::string &dbpath, const Options &options);
+
+  ~DB() override;
+
+  /// a forward-only cursor streaming the rows of a query
+  ///
+  /// Column values are read directly from sqlite and stay valid until the
+  /// cursor is advanced. Queries must not run concurrently with writes from
+  /// other threads.
+  class Cursor {
+  public:
+    Cursor(Cursor &&other);
+    Cursor(const Cursor &) = delete;
+    Cursor &operator=(const Cursor &) = delete;
+
+    ~Cursor();
+
+    /// bind a value to the parameter with 1-based `index`
+    /// @{
+    Cursor &bind(int index, llvm::StringRef value);
+    Cursor &bind(int index, int64_t value);
+    /// @}
+
+    /// whether the query could be prepared
+    bool valid() const { return statement != nullptr; }
+
+    /// advance to the next row
+    ///
+    /// @returns false after the last row or on error
+    bool next();
+
+    /// rewind to before the first row to run the query again, e.g. after
+    /// binding new parameter values
+    void reset();
 
-  ~DB();
+    /// values of the current row
+    /// @{
+    llvm::StringRef text(int column) const;
+    int64_t integer(int column) const;
+    bool isNull(int column) const;
+    /// @}
 
+  private:
+    friend class DB;
+    Cursor(sqlite3_stmt *statement, sqlite3 *connection);
+
+    sqlite3_stmt *statement;
+    sqlite3 *connection;
+    bool done = false;
+  };
+
+  /// execute a statement, discarding any result rows
+  ///
+  /// Safe to call from multiple threads.
   bool execute(const std::string &statement) const;
 
-  mutable std::vector<std::vector<std::string>> rows;
+  /// prepare a query; the returned cursor is positioned before the first row
+  Cursor query(llvm::StringRef sql) const;
+
+  /// open a transaction for a bulk load
+  ///
+  /// While the transaction is open it is committed and reopened every
+  /// `Options::BatchSize` inserted rows.
+  bool begin() const override;
+
+  /// commit the transaction opened with `begin`
+  bool commit() const override;
+
+  /// typed inserts using cached prepared statements; duplicates are ignored
+  ///
+  /// Classes and relations are kept per file they are recorded from, so
+  /// that `removeRecordsFromFile` only removes those recorded from that file.
+  /// @{
+  bool insertClass(llvm::StringRef name, llvm::StringRef ns,
+                   llvm::StringRef file) const override;
+  bool insertTemplateInstance(llvm::StringRef instance,
+                              llvm::StringRef tmpl,
+                              llvm::StringRef templateArgs,
+                              llvm::StringRef file) const override;
+  bool insertMethod(llvm::StringRef cls, llvm::StringRef name,
+                    llvm::StringRef returns, llvm::StringRef parameters,
+                    int access, bool isStatic, bool isAbstract,
+                    llvm::StringRef file) const override;
+  bool insertOwns(llvm::StringRef owner, llvm::StringRef object,
+                  llvm::StringRef name, llvm::StringRef file) const override;
+  bool insertUses(llvm::StringRef user, llvm::StringRef object,
+                  llvm::StringRef file) const override;
+  bool insertInheritance(llvm::StringRef derived, llvm::StringRef base,
+                         llvm::StringRef file) const override;
+  /// @}
+
+  bool insertCountedInstance(llvm::StringRef tmpl, llvm::StringRef ns,
+                             int64_t hash, bool collapsed) const override;
+
+  /// record that the translation unit at `path` was parsed
+  ///
+  /// @param commandHash hash of the compile command and extraction settings
+  /// @param dependencies all files read with a hash of their contents
+  /// @param cost the memory and time the parse took
+  bool insertTranslationUnit(
+      llvm::StringRef path, int64_t commandHash,
+      const std::vector<std::pair<std::string, int64_t>> &dependencies,
+      const TranslationUnitCost &cost) const override;
+
+  /// collect the neighbourhood of the requested classes of scoped reports
+  bool selectReport(const ReportKind &kind) const override;
+
+  /// stream the rows to report from ordered queries
+  ///
+  /// Classes and their relations are read in a single pass, merging queries
+  /// ordered alike, so no more than a row of each is held at a time.
+  /// @{
+  bool visitClasses(const ReportKind &kind,
+                    ReportVisitor &visitor) const override;
+  bool visitTemplateInstances(const ReportKind &kind,
+                              ReportVisitor &visitor) const override;
+  bool visitInheritance(const ReportKind &kind,
+                        ReportVisitor &visitor) const override;
+  /// @}
+
+  /// look up what was recorded by `insertTranslationUnit`
+  ///
+  /// @returns false if the translation unit was never recorded
+  bool lookupTranslationUnit(
+      llvm::StringRef path, int64_t &commandHash,
+      std::vector<std::pair<std::string, int64_t>> &dependencies) const;
+
+  /// look up the costs recorded by `insertTranslationUnit` for all
+  /// translation units, by path
+  bool lookupTranslationUnitCosts(
+      llvm::StringMap<TranslationUnitCost> &costs) const;
+
+  /// remove all classes defined in the file at `path` and the relations
+  /// recorded for them
+  bool removeRecordsFromFile(llvm::StringRef path) const;
+
+  /// add all records of the database at `path` to this one
+  ///
+  /// Rows already present are kept, as when inserting them in a single run;
+  /// translation units are replaced as when they were parsed again.
+  bool merge(const std::string &path) const;
 
   sqlite3 *connection;
 
 private:
-  mutable sqlite3_stmt *stmt;
+  mutable std::mutex mutex;
+
+  const Options options;
+
+  /// prepared statements by SQL text, finalized on destruction
+  mutable llvm::StringMap<sqlite3_stmt *> statements;
+
+  /// ids of interned class and type names, with the names in an arena
+  mutable llvm::StringMap<int64_t, llvm::BumpPtrAllocator> nameIds;
+
+  /// ids of files, which are never removed
+  mutable llvm::StringMap<int64_t> fileIds;
+
+  /// whether a bulk load transaction is open, and the rows it holds
+  mutable bool inTransaction = false;
+  mutable size_t pendingRows = 0;
+
+  /// look up or prepare a cached statement; requires `mutex` to be held
+  sqlite3_stmt *prepare(llvm::StringRef sql) const;
+
+  /// run a bound insert statement and reset it; requires `mutex` to be held
+  ///
+  /// @param countRow whether the row is counted for `-stats`; only rows of
+  /// classes and their relations are, as by other storage
+  bool insert(sqlite3_stmt *statement, bool countRow = false) const;
+
+  /// move tables storing class names as text out of the way
+  ///
+  /// @param renamed set to whether there were such tables
+  bool renameLegacyTables(bool &renamed) const;
+
+  /// convert the tables renamed by `renameLegacyTables` to interned names
+  bool migrateLegacyTables() const;
+
+  /// drop the per-name template counts of earlier versions, so that all
+  /// translation units are parsed again to count instantiations
+  bool dropTemplateCounts() const;
+
+  /// whether all tables queried by reports and diffs exist in the current,
+  /// interned form
+  bool hasReadableSchema() const;
+
+  /// add columns introduced after a table was first created, and widen the
+  /// unique indices to the file rows are recorded from
+  bool addMissingColumns() const;
+
+  /// look up or intern a class or type name; requires `mutex` to be held
+  std::optional<int64_t> nameId(llvm::StringRef name) const;
+
+  /// look up or create the id of a file; requires `mutex` to be held
+  std::optional<int64_t> fileId(llvm::StringRef path) const;
+
+  /// the file id stored with relations, 0 if `path` is not tracked;
+  /// requires `mutex` to be held
+  int64_t relationFile(llvm::StringRef path) const;
+
+  /// run a statement without results; requires `mutex` to be held
+  bool run(const char *sql) const;
+
+  /// collect the neighbourhood of the classes requested by `kind` in the
+  /// temporary table `report_scope`
+  bool defineScope(const ReportKind &kind) const;
 
-  bool step() const;
+  /// a condition selecting rows with `column` in the reported neighbourhood
+  static std::string inScope(const ReportKind &kind, llvm::StringRef column);
 };
 
 #endif // DB_H
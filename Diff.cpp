@@ -0,0 +1,317 @@
+#include "Diff.h"
+
+#include <algorithm>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "clang/Basic/Specifiers.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/ADT/Twine.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "DB.h"
+
+namespace {
+enum class Change { Added, Removed };
+
+/// a kind of row compared between databases
+struct Relation {
+  /// how changes are labelled
+  llvm::StringRef Kind;
+  /// a query of all rows as text, ordered by all its columns
+  std::string Query;
+  int Columns;
+};
+
+/// the kinds of rows compared, with queries whose order matches the
+/// comparison of their columns as text
+///
+/// Classes and relations recorded from several files are compared once.
+std::vector<Relation> relations() {
+  const auto Access = [](clang::AccessSpecifier A) {
+    return (" WHEN " + llvm::Twine(static_cast<int>(A)) + " THEN ").str();
+  };
+
+  return {
+      {"class",
+       "SELECT DISTINCT n.name, IFNULL(c.namespace, '') FROM classes c "
+       "JOIN names n ON n.id = c.name ORDER BY 1, 2",
+       2},
+      {"method",
+       "SELECT DISTINCT c.name, m.name, IFNULL(r.name, ''), "
+       "IFNULL(m.parameters, ''), CASE m.access" +
+           Access(clang::AS_public) + "'+'" + Access(clang::AS_private) +
+           "'-'" + Access(clang::AS_protected) +
+           "'#' ELSE '' END, "
+           "CASE WHEN m.static THEN '{static}' ELSE '' END, "
+           "CASE WHEN m.abstract THEN '{abstract}' ELSE '' END "
+           "FROM methods m JOIN names c ON c.id = m.class "
+           "LEFT JOIN names r ON r.id = m.returns "
+           "ORDER BY 1, 2, 3, 4, 5, 6, 7",
+       7},
+      {"inherits",
+       "SELECT DISTINCT d.name, b.name FROM inheritance i "
+       "JOIN names d ON d.id = i.derived "
+       "JOIN names b ON b.id = i.base ORDER BY 1, 2",
+       2},
+      {"owns",
+       "SELECT DISTINCT o.name, b.name, w.name FROM owns w "
+       "JOIN names o ON o.id = w.owner "
+       "JOIN names b ON b.id = w.object ORDER BY 1, 2, 3",
+       3},
+      {"uses",
+       "SELECT DISTINCT u.name, b.name FROM uses s "
+       "JOIN names u ON u.id = s.user "
+       "JOIN names b ON b.id = s.object ORDER BY 1, 2",
+       2},
+  };
+}
+
+/// call @p Changed with every row of @p R in only one of the databases
+///
+/// Both queries are stepped through once, like merging sorted lists. sqlite
+/// orders text by its bytes, as `StringRef::compare` does.
+template <typename Callback>
+bool compare(const DB &Old, const DB &New, const Relation &R,
+             Callback &&Changed) {
+  auto Removed = Old.query(R.Query);
+  auto Added = New.query(R.Query);
+  if (not Removed.valid() or not Added.valid())
+    return false;
+
+  const auto Compare = [&]() {
+    for (int I = 0; I < R.Columns; ++I)
+      if (const auto C = Removed.text(I).compare(Added.text(I)))
+        return C;
+    return 0;
+  };
+
+  auto HasRemoved = Removed.next();
+  auto HasAdded = Added.next();
+  while (HasRemoved or HasAdded) {
+    const auto C = not HasAdded ? -1 : not HasRemoved ? 1 : Compare();
+    if (C < 0) {
+      Changed(Change::Removed, Removed);
+      HasRemoved = Removed.next();
+    } else if (C > 0) {
+      Changed(Change::Added, Added);
+      HasAdded = Added.next();
+    } else {
+      HasRemoved = Removed.next();
+      HasAdded = Added.next();
+    }
+  }
+  return true;
+}
+
+/// a method as shown in class diagrams
+std::string methodText(const DB::Cursor &Row) {
+  const auto Returns = Row.text(2) == "void" ? llvm::StringRef() : Row.text(2);
+  auto Text = (Row.text(4) + Returns + " " + Row.text(1) + "(" + Row.text(3) +
+               ") " + Row.text(5) + Row.text(6))
+                  .str();
+  Text.resize(llvm::StringRef(Text).rtrim().size());
+  return Text;
+}
+
+/// write a change as a line of text
+void writeChange(llvm::raw_ostream &OS, Change C, const Relation &R,
+                 const DB::Cursor &Row) {
+  OS << (C == Change::Added ? "+ " : "- ") << R.Kind << " ";
+  if (R.Kind == "class") {
+    if (not Row.text(1).empty())
+      OS << Row.text(1) << "::";
+    OS << Row.text(0);
+  } else if (R.Kind == "method") {
+    OS << Row.text(0) << ": " << methodText(Row);
+  } else {
+    OS << Row.text(0) << " -> " << Row.text(1);
+    if (R.Columns > 2)
+      OS << " : " << Row.text(2);
+  }
+  OS << "\n";
+}
+
+/// the changes between two databases, collected to draw them
+///
+/// Only holds what changed and the classes changes refer to.
+class DiffDiagram {
+public:
+  void add(Change C, const Relation &R, const DB::Cursor &Row) {
+    if (R.Kind == "class") {
+      // a class moved between namespaces has neither been added nor removed
+      auto Inserted = Classes.try_emplace(Row.text(0), status(C));
+      if (not Inserted.second and Inserted.first->second != status(C))
+        Inserted.first->second = Status::Touched;
+      return;
+    }
+
+    Classes.try_emplace(Row.text(0), Status::Touched);
+    if (R.Kind == "method") {
+      Methods[Row.text(0)].emplace_back(C, methodText(Row));
+      return;
+    }
+
+    Classes.try_emplace(Row.text(1), Status::Touched);
+    Edges.push_back({C, R.Kind, Row.text(0).str(), Row.text(1).str(),
+                     R.Columns > 2 ? Row.text(2).str() : std::string()});
+  }
+
+  void writePlantUML(llvm::raw_ostream &OS) const {
+    writePlantUMLBegin(OS);
+
+    for (const auto &Name : sortedClasses()) {
+      OS << "class \"" << Name << "\"";
+      const auto S = Classes.lookup(Name);
+      if (S != Status::Touched)
+        OS << (S == Status::Added ? " #palegreen" : " #pink");
+      OS << " {\n";
+
+      const auto It = Methods.find(Name);
+      if (It != Methods.end())
+        for (const auto &Method : It->second)
+          OS << "  <color:" << colour(Method.first) << ">" << Method.second
+             << "</color>\n";
+      OS << "}\n";
+    }
+
+    for (const auto &E : Edges) {
+      const auto Colour = "[#" + colour(E.C) + "]";
+      OS << "\"" << E.From << "\" ";
+      if (E.Kind == "inherits")
+        OS << "-" << Colour << "-|>";
+      else if (E.Kind == "owns")
+        OS << "*-" << Colour << "-";
+      else
+        OS << "-" << Colour << "->";
+      OS << " \"" << E.To << "\"";
+      if (not E.Label.empty())
+        OS << " : \"" << E.Label << "\"";
+      OS << "\n";
+    }
+
+    writePlantUMLEnd(OS);
+  }
+
+  void writeDot(llvm::raw_ostream &OS) const {
+    OS << "digraph G {\n";
+
+    for (const auto &Name : sortedClasses()) {
+      writeQuoted(OS, Name);
+      const auto S = Classes.lookup(Name);
+      const auto It = Methods.find(Name);
+      if (S == Status::Touched and It == Methods.end()) {
+        OS << ";\n";
+        continue;
+      }
+
+      OS << " [";
+      if (S != Status::Touched) {
+        const auto Colour = colour(S == Status::Added ? Change::Added
+                                                      : Change::Removed);
+        OS << "color=" << Colour << ", fontcolor=" << Colour;
+        if (It != Methods.end())
+          OS << ", ";
+      }
+
+      // changed methods are listed below the name, like in plantuml
+      if (It != Methods.end()) {
+        OS << "shape=box, label=<";
+        llvm::printHTMLEscaped(Name, OS);
+        for (const auto &Method : It->second) {
+          OS << "<br align=\"left\"/><font color=\"" << colour(Method.first)
+             << "\">";
+          llvm::printHTMLEscaped(Method.second, OS);
+          OS << "</font>";
+        }
+        OS << "<br align=\"left\"/>>";
+      }
+      OS << "];\n";
+    }
+
+    for (const auto &E : Edges) {
+      writeQuoted(OS, E.From);
+      OS << " -> ";
+      writeQuoted(OS, E.To);
+      OS << " [color=" << colour(E.C);
+      if (E.Kind == "owns") {
+        OS << ", arrowtail=diamond, dir=back, label=";
+        writeQuoted(OS, E.Label);
+      } else if (E.Kind == "uses") {
+        OS << ", style=dashed";
+      }
+      OS << "]\n";
+    }
+
+    OS << "}\n";
+  }
+
+private:
+  /// how a class appears in the diagram
+  enum class Status { Touched, Added, Removed };
+
+  struct Edge {
+    Change C;
+    llvm::StringRef Kind;
+    std::string From;
+    std::string To;
+    std::string Label;
+  };
+
+  static Status status(Change C) {
+    return C == Change::Added ? Status::Added : Status::Removed;
+  }
+
+  static std::string colour(Change C) {
+    return C == Change::Added ? "green" : "red";
+  }
+
+  std::vector<llvm::StringRef> sortedClasses() const {
+    std::vector<llvm::StringRef> Names;
+    Names.reserve(Classes.size());
+    for (const auto &Entry : Classes)
+      Names.push_back(Entry.first());
+    std::sort(Names.begin(), Names.end());
+    return Names;
+  }
+
+  llvm::StringMap<Status> Classes;
+  llvm::StringMap<std::vector<std::pair<Change, std::string>>> Methods;
+  std::vector<Edge> Edges;
+};
+} // namespace
+
+bool diff(const DB &Old, const DB &New, bool Diagram, ReportType Type,
+          llvm::raw_ostream &OS) {
+  if (Diagram and Type != plantuml and Type != dot) {
+    llvm::errs() << "COULD NOT DRAW DIFF, only plantuml and dot diagrams are "
+                    "supported\n";
+    return false;
+  }
+
+  DiffDiagram Changes;
+  for (const auto &R : relations()) {
+    const auto Compared =
+        compare(Old, New, R, [&](Change C, const DB::Cursor &Row) {
+          if (Diagram)
+            Changes.add(C, R, Row);
+          else
+            writeChange(OS, C, R, Row);
+        });
+    if (not Compared) {
+      llvm::errs() << "COULD NOT COMPARE " << R.Kind << " ROWS\n";
+      return false;
+    }
+  }
+
+  if (Diagram) {
+    if (Type == plantuml)
+      Changes.writePlantUML(OS);
+    else
+      Changes.writeDot(OS);
+  }
+  return true;
+}
@@ -0,0 +1,27 @@
+#ifndef DIFF_H
+#define DIFF_H
+
+#include "Report.h"
+
+class DB;
+
+namespace llvm {
+class raw_ostream;
+} // namespace llvm
+
+/// write the classes, methods, bases, owns and uses relations added to
+/// @p New or removed from @p Old
+///
+/// Every kind of row is read from both databases sorted by its text and the
+/// two streams are compared in a single pass, so neither per-row lookups nor
+/// memory growing with the databases are needed. Changes are written one per
+/// line, prefixed with `+` or `-`.
+///
+/// @param Diagram draw the changed classes, methods and relations as a diagram
+/// in the format @p Type instead, added ones in green and removed ones in red;
+/// only `plantuml` and `dot` are supported
+/// @returns false on errors
+bool diff(const DB &Old, const DB &New, bool Diagram, ReportType Type,
+          llvm::raw_ostream &OS);
+
+#endif // DIFF_H
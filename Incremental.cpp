@@ -0,0 +1,95 @@
+#include "Incremental.h"
+
+#include <utility>
+
+#include "clang/Tooling/CompilationDatabase.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringSet.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/xxhash.h"
+
+#include "DB.h"
+
+std::optional<uint64_t> FileHashes::get(llvm::StringRef Path) {
+  {
+    std::lock_guard<std::mutex> Lock(Mutex);
+    const auto It = Cache.find(Path);
+    if (It != Cache.end())
+      return It->second;
+  }
+
+  std::optional<uint64_t> Hash;
+  if (auto Buffer = llvm::MemoryBuffer::getFile(Path))
+    Hash = llvm::xxHash64((*Buffer)->getBuffer());
+
+  std::lock_guard<std::mutex> Lock(Mutex);
+  Cache[Path] = Hash;
+  return Hash;
+}
+
+void FileHashes::invalidate(llvm::StringRef Path) {
+  std::lock_guard<std::mutex> Lock(Mutex);
+  Cache.erase(Path);
+}
+
+std::string translationUnitPath(llvm::StringRef Source) {
+  llvm::SmallString<256> Path(Source);
+  llvm::sys::fs::make_absolute(Path);
+  llvm::sys::path::remove_dots(Path, /*remove_dot_dot=*/true);
+  return std::string(Path.str());
+}
+
+uint64_t
+commandHash(const clang::tooling::CompilationDatabase &Compilations,
+            llvm::StringRef Source, llvm::StringRef Settings) {
+  std::string Key = Settings.str();
+  for (const auto &Command : Compilations.getCompileCommands(Source)) {
+    Key += '\0';
+    Key += Command.Directory;
+    for (const auto &Argument : Command.CommandLine) {
+      Key += '\0';
+      Key += Argument;
+    }
+  }
+
+  return llvm::xxHash64(Key);
+}
+
+std::vector<std::string>
+selectChangedSources(const clang::tooling::CompilationDatabase &Compilations,
+                     const std::vector<std::string> &Sources, const DB &Db,
+                     llvm::StringRef Settings, FileHashes &Hashes) {
+  std::vector<std::string> Changed;
+  llvm::StringSet<> Purged;
+
+  for (const auto &Source : Sources) {
+    const auto Path = translationUnitPath(Source);
+
+    int64_t StoredCommand = 0;
+    std::vector<std::pair<std::string, int64_t>> Dependencies;
+    if (not Db.lookupTranslationUnit(Path, StoredCommand, Dependencies)) {
+      Changed.push_back(Source); // never parsed before
+      continue;
+    }
+
+    bool Unchanged = static_cast<uint64_t>(StoredCommand) ==
+                     commandHash(Compilations, Source, Settings);
+
+    for (const auto &Dependency : Dependencies) {
+      const auto Hash = Hashes.get(Dependency.first);
+      if (Hash and static_cast<int64_t>(*Hash) == Dependency.second)
+        continue;
+
+      Unchanged = false;
+      if (Purged.insert(Dependency.first).second)
+        Db.removeRecordsFromFile(Dependency.first);
+    }
+
+    if (not Unchanged)
+      Changed.push_back(Source);
+  }
+
+  return Changed;
+}
@@ -0,0 +1,61 @@
+#ifndef INCREMENTAL_H
+#define INCREMENTAL_H
+
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+
+namespace clang {
+namespace tooling {
+class CompilationDatabase;
+} // namespace tooling
+} // namespace clang
+
+class DB;
+
+/// hashes of file contents, computed at most once per run
+///
+/// Safe to use from multiple threads.
+class FileHashes {
+public:
+  /// @returns the hash of the current contents of the file at @p Path, or
+  /// nothing if it cannot be read
+  std::optional<uint64_t> get(llvm::StringRef Path);
+
+  /// forget the hash of the file at @p Path, e.g. after it was modified
+  void invalidate(llvm::StringRef Path);
+
+private:
+  std::mutex Mutex;
+  llvm::StringMap<std::optional<uint64_t>> Cache;
+};
+
+/// the key under which a translation unit is tracked in the database
+std::string translationUnitPath(llvm::StringRef Source);
+
+/// hash the compile commands for @p Source together with @p Settings
+///
+/// @param Settings a description of all tool options affecting which records
+/// are extracted
+uint64_t
+commandHash(const clang::tooling::CompilationDatabase &Compilations,
+            llvm::StringRef Source, llvm::StringRef Settings);
+
+/// select the sources which need to be parsed again
+///
+/// A translation unit is skipped if its compile command, extraction settings
+/// and the contents of all files it depended on when it was last parsed are
+/// unchanged. Rows originating from files whose contents changed are removed
+/// from @p Db so that parsing the returned sources inserts them afresh; only
+/// sources which are parsed if selected may be given, e.g. after filtering.
+std::vector<std::string>
+selectChangedSources(const clang::tooling::CompilationDatabase &Compilations,
+                     const std::vector<std::string> &Sources, const DB &Db,
+                     llvm::StringRef Settings, FileHashes &Hashes);
+
+#endif // INCREMENTAL_H
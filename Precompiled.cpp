@@ -0,0 +1,341 @@
+#include "Precompiled.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <system_error>
+#include <utility>
+
+#include "clang/Basic/FileManager.h"
+#include "clang/Basic/FileSystemOptions.h"
+#include "clang/Basic/SourceManager.h"
+#include "clang/Frontend/CompilerInstance.h"
+#include "clang/Frontend/CompilerInvocation.h"
+#include "clang/Frontend/FrontendActions.h"
+#include "clang/Tooling/ArgumentsAdjusters.h"
+#include "clang/Tooling/CompilationDatabase.h"
+#include "clang/Tooling/Tooling.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/Twine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/FormatVariadic.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/VirtualFileSystem.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/xxhash.h"
+
+namespace {
+/// an address within this binary to find clang's resource directory from
+int StaticSymbol;
+
+/// the `#include` directives a source starts with
+///
+/// Only blank lines and comments may precede or separate them; any other
+/// line, including other directives which could affect the includes, ends
+/// the block.
+///
+/// @param Quoted set if any of the includes is quoted
+std::vector<std::string> leadingIncludes(llvm::StringRef Source,
+                                         bool &Quoted) {
+  std::vector<std::string> Includes;
+  Quoted = false;
+
+  auto Buffer = llvm::MemoryBuffer::getFile(Source, /*IsText=*/false,
+                                            /*RequiresNullTerminator=*/false);
+  if (not Buffer)
+    return Includes;
+
+  bool InComment = false;
+  for (auto Rest = (*Buffer)->getBuffer(); not Rest.empty();) {
+    const auto Split = Rest.split('\n');
+    auto Line = Split.first.trim();
+    Rest = Split.second;
+
+    if (InComment) {
+      if (not Line.contains("*/"))
+        continue;
+      InComment = false;
+      Line = Line.split("*/").second.trim();
+    }
+
+    if (Line.empty() or Line.startswith("//"))
+      continue;
+    if (Line.startswith("/*")) {
+      if (not Line.contains("*/")) {
+        InComment = true;
+        continue;
+      }
+      Line = Line.split("*/").second.trim();
+      if (Line.empty())
+        continue;
+    }
+
+    if (not Line.consume_front("#"))
+      break;
+    Line = Line.ltrim();
+    if (not Line.consume_front("include"))
+      break;
+    Line = Line.ltrim();
+    if (Line.empty() or (Line.front() != '"' and Line.front() != '<'))
+      break; // e.g. `include_next` or a macro include
+
+    const auto IsQuoted = Line.front() == '"';
+    const auto End = Line.find(IsQuoted ? '"' : '>', 1);
+    if (End == llvm::StringRef::npos)
+      break;
+
+    Quoted = Quoted or IsQuoted;
+    Includes.push_back(("#include " + Line.take_front(End + 1)).str());
+  }
+
+  return Includes;
+}
+
+/// the arguments of @p Command without the source, its output and
+/// dependency files
+std::vector<std::string>
+commonArguments(const clang::tooling::CompileCommand &Command) {
+  using namespace clang::tooling;
+
+  auto Arguments =
+      getClangStripOutputAdjuster()(Command.CommandLine, Command.Filename);
+  Arguments = getClangStripDependencyFileAdjuster()(Arguments,
+                                                    Command.Filename);
+
+  const auto Absolute = [&Command](llvm::StringRef Name) {
+    llvm::SmallString<256> Path(Name);
+    llvm::sys::fs::make_absolute(Command.Directory, Path);
+    llvm::sys::path::remove_dots(Path, /*remove_dot_dot=*/true);
+    return std::string(Path.str());
+  };
+  const auto Source = Absolute(Command.Filename);
+
+  std::vector<std::string> Result;
+  Result.reserve(Arguments.size());
+  for (auto &Argument : Arguments) {
+    if (Argument == "-c" or
+        (not Argument.empty() and Argument.front() != '-' and
+         Absolute(Argument) == Source))
+      continue;
+    Result.emplace_back(std::move(Argument));
+  }
+  return Result;
+}
+
+/// generates a precompiled header, collecting the files it reads
+class PrecompileAction : public clang::GeneratePCHAction {
+public:
+  PrecompileAction(llvm::StringRef Header,
+                   std::vector<std::string> &Dependencies)
+      : Header(Header), Dependencies(Dependencies) {}
+
+protected:
+  void EndSourceFileAction() override {
+    const auto &SM = getCompilerInstance().getSourceManager();
+    for (auto It = SM.fileinfo_begin(); It != SM.fileinfo_end(); ++It) {
+      llvm::SmallString<256> Path(It->first->getName());
+      SM.getFileManager().makeAbsolutePath(Path);
+      llvm::sys::path::remove_dots(Path, /*remove_dot_dot=*/true);
+      if (Path != Header)
+        Dependencies.emplace_back(Path.str());
+    }
+
+    clang::GeneratePCHAction::EndSourceFileAction();
+  }
+
+private:
+  const std::string Header;
+  std::vector<std::string> &Dependencies;
+};
+
+/// reuse @p Pch from an earlier run if none of the files it read changed
+bool reuse(PrecompiledHeader &Pch) {
+  llvm::sys::fs::file_status Status;
+  if (llvm::sys::fs::status(Pch.Path, Status))
+    return false;
+
+  const auto Listed = llvm::MemoryBuffer::getFile(Pch.Path + ".d");
+  if (not Listed)
+    return false;
+
+  llvm::SmallVector<llvm::StringRef, 64> Lines;
+  (*Listed)->getBuffer().split(Lines, '\n', -1, /*KeepEmpty=*/false);
+
+  std::vector<std::string> Dependencies;
+  Dependencies.reserve(Lines.size());
+  for (const auto Line : Lines) {
+    llvm::sys::fs::file_status Dependency;
+    if (llvm::sys::fs::status(Line, Dependency) or
+        Dependency.getLastModificationTime() >
+            Status.getLastModificationTime())
+      return false;
+    Dependencies.push_back(Line.str());
+  }
+
+  Pch.Dependencies = std::move(Dependencies);
+  return true;
+}
+
+/// build @p Pch unless an up-to-date one exists
+bool build(PrecompiledHeader &Pch,
+           const llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> &FS) {
+  if (reuse(Pch))
+    return true;
+
+  std::error_code EC;
+  {
+    llvm::raw_fd_ostream OS(Pch.Header, EC, llvm::sys::fs::OF_Text);
+    if (not EC)
+      OS << Pch.HeaderContents;
+  }
+  if (EC) {
+    llvm::errs() << "COULD NOT WRITE " << Pch.Header << ": " << EC.message()
+                 << "\n";
+    return false;
+  }
+
+  std::vector<std::string> Dependencies;
+  FS->setCurrentWorkingDirectory(Pch.Directory);
+  llvm::IntrusiveRefCntPtr<clang::FileManager> Files(
+      new clang::FileManager(clang::FileSystemOptions(), FS));
+  clang::tooling::ToolInvocation Invocation(
+      Pch.CommandLine,
+      std::make_unique<PrecompileAction>(Pch.Header, Dependencies),
+      Files.get());
+  if (not Invocation.run()) {
+    llvm::errs() << "COULD NOT PRECOMPILE " << Pch.Header << "\n";
+    llvm::sys::fs::remove(Pch.Path);
+    return false;
+  }
+
+  {
+    llvm::raw_fd_ostream OS(Pch.Path + ".d", EC, llvm::sys::fs::OF_Text);
+    for (const auto &Dependency : Dependencies)
+      OS << Dependency << "\n";
+  }
+  if (EC)
+    llvm::errs() << "COULD NOT WRITE " << Pch.Path << ".d: " << EC.message()
+                 << "\n";
+
+  Pch.Dependencies = std::move(Dependencies);
+  return true;
+}
+} // namespace
+
+PrecompiledHeaders::PrecompiledHeaders(
+    const clang::tooling::CompilationDatabase &Compilations,
+    const std::vector<std::string> &Sources, llvm::StringRef CacheDirectory,
+    unsigned MinSources) {
+  // a header used by a single source only costs time
+  MinSources = std::max(MinSources, 2u);
+
+  llvm::SmallString<256> Cache(CacheDirectory);
+  llvm::sys::fs::make_absolute(Cache);
+  if (const auto EC = llvm::sys::fs::create_directories(Cache)) {
+    llvm::errs() << "COULD NOT CREATE " << Cache << ": " << EC.message()
+                 << "\n";
+    return;
+  }
+
+  struct Candidate {
+    const std::string *Source;
+    clang::tooling::CompileCommand Command;
+    std::vector<std::string> Arguments;
+    std::vector<std::string> Includes;
+    std::string QuoteDirectory;
+    /// the key of every prefix of the includes
+    std::vector<uint64_t> Keys;
+  };
+
+  std::vector<Candidate> Candidates;
+  llvm::DenseMap<uint64_t, unsigned> Counts;
+  for (const auto &Source : Sources) {
+    auto Commands = Compilations.getCompileCommands(Source);
+    if (Commands.empty())
+      continue;
+
+    auto C = Candidate{&Source, std::move(Commands.front()), {}, {}, {}, {}};
+    bool Quoted = false;
+    C.Includes = leadingIncludes(Source, Quoted);
+    if (C.Includes.empty())
+      continue;
+    C.Arguments = commonArguments(C.Command);
+
+    // quoted includes are resolved relative to the source first, so the
+    // generated header searches its directory
+    if (Quoted)
+      C.QuoteDirectory =
+          llvm::sys::path::parent_path(C.Command.Filename).str();
+
+    std::string Key = C.Command.Directory + '\0' + C.QuoteDirectory;
+    for (const auto &Argument : C.Arguments)
+      Key += '\0' + Argument;
+    for (const auto &Include : C.Includes) {
+      Key += '\n' + Include;
+      C.Keys.push_back(llvm::xxHash64(Key));
+      ++Counts[C.Keys.back()];
+    }
+
+    Candidates.emplace_back(std::move(C));
+  }
+
+  llvm::DenseMap<uint64_t, PrecompiledHeader *> ByKey;
+  for (auto &C : Candidates) {
+    // the longest prefix shared by enough sources
+    auto Length = C.Keys.size();
+    while (Length > 0 and Counts[C.Keys[Length - 1]] < MinSources)
+      --Length;
+    if (Length == 0)
+      continue;
+
+    const auto Key = C.Keys[Length - 1];
+    auto &Pch = ByKey[Key];
+    if (not Pch) {
+      Headers.push_back(std::make_unique<PrecompiledHeader>());
+      Pch = Headers.back().get();
+
+      llvm::SmallString<256> Base(Cache);
+      llvm::sys::path::append(Base, llvm::formatv("{0:x-16}", Key).str());
+      Pch->Path = (Base + ".pch").str();
+      Pch->Header = (Base + ".h").str();
+      for (size_t I = 0; I < Length; ++I)
+        Pch->HeaderContents += C.Includes[I] + "\n";
+
+      const auto IsC = llvm::sys::path::extension(C.Command.Filename) == ".c";
+      // match the resource directory `ClangTool` parses sources with
+      Pch->CommandLine = std::move(C.Arguments);
+      if (llvm::none_of(Pch->CommandLine, [](llvm::StringRef Argument) {
+            return Argument.startswith("-resource-dir");
+          }))
+        Pch->CommandLine.insert(
+            std::next(Pch->CommandLine.begin()),
+            "-resource-dir=" + clang::CompilerInvocation::GetResourcesPath(
+                                   "clang_tool", &StaticSymbol));
+      Pch->CommandLine.insert(Pch->CommandLine.end(),
+                              {"-x", IsC ? "c-header" : "c++-header",
+                               Pch->Header, "-o", Pch->Path});
+      if (not C.QuoteDirectory.empty())
+        Pch->CommandLine.insert(Pch->CommandLine.end(),
+                                {"-iquote", C.QuoteDirectory});
+      Pch->Directory = C.Command.Directory;
+    }
+
+    BySource[*C.Source] = Pch;
+  }
+}
+
+const PrecompiledHeader *PrecompiledHeaders::get(
+    llvm::StringRef Source,
+    const llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> &FS) {
+  const auto It = BySource.find(Source);
+  if (It == BySource.end())
+    return nullptr;
+
+  auto &Pch = *It->second;
+  std::call_once(Pch.Built, [&]() { Pch.Valid = build(Pch, FS); });
+  return Pch.Valid ? &Pch : nullptr;
+}
@@ -0,0 +1,72 @@
+#ifndef PRECOMPILED_H
+#define PRECOMPILED_H
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "llvm/ADT/IntrusiveRefCntPtr.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+
+namespace clang {
+namespace tooling {
+class CompilationDatabase;
+} // namespace tooling
+} // namespace clang
+
+namespace llvm {
+namespace vfs {
+class FileSystem;
+} // namespace vfs
+} // namespace llvm
+
+/// a precompiled header for the leading includes shared by some sources
+struct PrecompiledHeader {
+  /// the precompiled header and the header it is generated from
+  std::string Path;
+  std::string Header;
+  std::string HeaderContents;
+
+  /// the command line and working directory to build it with
+  std::vector<std::string> CommandLine;
+  std::string Directory;
+
+  /// all files read when building it
+  std::vector<std::string> Dependencies;
+
+  std::once_flag Built;
+  bool Valid = false;
+};
+
+/// precompiled headers for the leading include blocks of sources
+///
+/// Sources compiled with the same flags which start with the same `#include`
+/// directives share a precompiled header of the longest such prefix common
+/// to enough of them. Headers are built on first use and kept in a cache
+/// directory, from which later runs reuse them while none of the files they
+/// read changed.
+///
+/// Safe to use from multiple threads.
+class PrecompiledHeaders {
+public:
+  /// @param MinSources the number of sources which must share a prefix
+  PrecompiledHeaders(const clang::tooling::CompilationDatabase &Compilations,
+                     const std::vector<std::string> &Sources,
+                     llvm::StringRef CacheDirectory, unsigned MinSources);
+
+  /// the precompiled header to use for @p Source, built if needed
+  ///
+  /// @param FS the file system to build it on
+  /// @returns nothing if there is none or it could not be built
+  const PrecompiledHeader *
+  get(llvm::StringRef Source,
+      const llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> &FS);
+
+private:
+  std::vector<std::unique_ptr<PrecompiledHeader>> Headers;
+  llvm::StringMap<PrecompiledHeader *> BySource;
+};
+
+#endif // PRECOMPILED_H
@@ -0,0 +1,228 @@
+#include "Prefilter.h"
+
+#include <utility>
+
+#include "clang/Tooling/CompilationDatabase.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/ADT/StringSet.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+
+namespace {
+/// an `#include` directive
+struct Include {
+  std::string Name;
+  bool Quoted;
+};
+
+/// what a scan of a single file found
+struct ScannedFile {
+  bool Mentions = false;
+  std::vector<Include> Includes;
+};
+
+/// include search paths from a compile command
+struct SearchPaths {
+  std::vector<std::string> Quoted;
+  std::vector<std::string> Angled;
+};
+
+/// parse the include directive at the start of @p Line, if any
+bool parseInclude(llvm::StringRef Line, Include &Result) {
+  Line = Line.ltrim();
+  if (not Line.consume_front("#"))
+    return false;
+  Line = Line.ltrim();
+  if (not Line.consume_front("include_next") and
+      not Line.consume_front("include") and not Line.consume_front("import"))
+    return false;
+  Line = Line.ltrim();
+
+  if (Line.empty() or (Line.front() != '"' and Line.front() != '<'))
+    return false; // e.g. a macro include; cannot be resolved textually
+
+  Result.Quoted = Line.front() == '"';
+  const auto End = Line.find(Result.Quoted ? '"' : '>', 1);
+  if (End == llvm::StringRef::npos)
+    return false;
+  Result.Name = Line.slice(1, End).str();
+  return true;
+}
+
+class Scanner {
+public:
+  explicit Scanner(std::vector<std::string> Identifiers)
+      : Identifiers(std::move(Identifiers)) {}
+
+  /// whether @p Source or anything it includes mentions an identifier
+  bool mayMatch(llvm::StringRef Source, const SearchPaths &Paths) {
+    llvm::StringSet<> Visited;
+    std::vector<std::string> Worklist{Source.str()};
+
+    while (not Worklist.empty()) {
+      const auto File = std::move(Worklist.back());
+      Worklist.pop_back();
+      if (not Visited.insert(File).second)
+        continue;
+
+      const auto &Scanned = scan(File);
+      if (Scanned.Mentions)
+        return true;
+
+      const auto Directory = llvm::sys::path::parent_path(File);
+      for (const auto &Inc : Scanned.Includes) {
+        auto Resolved = resolve(Inc, Directory, Paths);
+        if (not Resolved.empty())
+          Worklist.emplace_back(std::move(Resolved));
+      }
+    }
+
+    return false;
+  }
+
+private:
+  std::vector<std::string> Identifiers;
+  llvm::StringMap<ScannedFile> Scanned;
+  llvm::StringMap<bool> Exists;
+
+  const ScannedFile &scan(llvm::StringRef Path) {
+    const auto It = Scanned.find(Path);
+    if (It != Scanned.end())
+      return It->second;
+
+    auto &Result = Scanned[Path];
+
+    // large files are memory mapped
+    auto Buffer = llvm::MemoryBuffer::getFile(Path, /*IsText=*/false,
+                                              /*RequiresNullTerminator=*/false);
+    if (not Buffer)
+      return Result;
+    const auto Contents = (*Buffer)->getBuffer();
+
+    for (const auto &Identifier : Identifiers) {
+      if (Contents.find(Identifier) != llvm::StringRef::npos) {
+        Result.Mentions = true;
+        return Result; // includes will not be needed
+      }
+    }
+
+    // only lines starting with a `#` can be include directives
+    for (size_t Pos = Contents.find('#'); Pos != llvm::StringRef::npos;
+         Pos = Contents.find('#', Pos + 1)) {
+      const auto LineStart = Contents.rfind('\n', Pos) + 1; // npos + 1 == 0
+      if (not Contents.slice(LineStart, Pos).trim().empty())
+        continue;
+
+      auto Inc = Include{};
+      if (parseInclude(Contents.substr(Pos, Contents.find('\n', Pos) - Pos),
+                       Inc))
+        Result.Includes.emplace_back(std::move(Inc));
+    }
+
+    return Result;
+  }
+
+  std::string resolve(const Include &Inc, llvm::StringRef Directory,
+                      const SearchPaths &Paths) {
+    if (llvm::sys::path::is_absolute(Inc.Name))
+      return exists(Inc.Name) ? Inc.Name : "";
+
+    const auto Candidate =
+        [&Inc](llvm::StringRef Dir) -> llvm::SmallString<256> {
+      llvm::SmallString<256> Path(Dir);
+      llvm::sys::path::append(Path, Inc.Name);
+      llvm::sys::path::remove_dots(Path, /*remove_dot_dot=*/true);
+      return Path;
+    };
+
+    if (Inc.Quoted) {
+      const auto Path = Candidate(Directory);
+      if (exists(Path))
+        return Path.str().str();
+      for (const auto &Dir : Paths.Quoted) {
+        const auto Path = Candidate(Dir);
+        if (exists(Path))
+          return Path.str().str();
+      }
+    }
+
+    for (const auto &Dir : Paths.Angled) {
+      const auto Path = Candidate(Dir);
+      if (exists(Path))
+        return Path.str().str();
+    }
+
+    return "";
+  }
+
+  bool exists(llvm::StringRef Path) {
+    const auto It = Exists.find(Path);
+    if (It != Exists.end())
+      return It->second;
+    return Exists[Path] = llvm::sys::fs::is_regular_file(Path);
+  }
+};
+
+/// collect the include paths of a compile command
+SearchPaths searchPaths(const clang::tooling::CompileCommand &Command) {
+  SearchPaths Paths;
+
+  const auto Absolute = [&Command](llvm::StringRef Dir) {
+    llvm::SmallString<256> Path(Dir);
+    if (not llvm::sys::path::is_absolute(Path))
+      llvm::sys::fs::make_absolute(Command.Directory, Path);
+    return Path.str().str();
+  };
+
+  const auto &Args = Command.CommandLine;
+  for (size_t I = 0; I < Args.size(); ++I) {
+    const llvm::StringRef Arg = Args[I];
+    for (const auto &Flag : {"-iquote", "-I", "-isystem", "-idirafter"}) {
+      if (not Arg.startswith(Flag))
+        continue;
+
+      llvm::StringRef Dir = Arg.drop_front(llvm::StringRef(Flag).size());
+      if (Dir.empty() and I + 1 < Args.size())
+        Dir = Args[++I];
+
+      auto &List = llvm::StringRef(Flag) == "-iquote" ? Paths.Quoted
+                                                      : Paths.Angled;
+      List.emplace_back(Absolute(Dir));
+      break;
+    }
+  }
+
+  return Paths;
+}
+} // namespace
+
+std::vector<std::string>
+prefilterSources(const clang::tooling::CompilationDatabase &Compilations,
+                 const std::vector<std::string> &Sources,
+                 const std::vector<std::string> &ClassNames) {
+  std::vector<std::string> Identifiers;
+  for (const llvm::StringRef Name : ClassNames)
+    Identifiers.emplace_back(Name.rsplit("::").second.empty()
+                                 ? Name.str()
+                                 : Name.rsplit("::").second.str());
+
+  Scanner Scan(std::move(Identifiers));
+  std::vector<std::string> Candidates;
+
+  for (const auto &Source : Sources) {
+    llvm::SmallString<256> Path(Source);
+    llvm::sys::fs::make_absolute(Path);
+
+    const auto Commands = Compilations.getCompileCommands(Source);
+    const auto Paths = Commands.empty() ? SearchPaths{}
+                                        : searchPaths(Commands.front());
+
+    if (Scan.mayMatch(Path, Paths))
+      Candidates.push_back(Source);
+  }
+
+  return Candidates;
+}
@@ -0,0 +1,27 @@
+#ifndef PREFILTER_H
+#define PREFILTER_H
+
+#include <string>
+#include <vector>
+
+namespace clang {
+namespace tooling {
+class CompilationDatabase;
+} // namespace tooling
+} // namespace clang
+
+/// select the sources which may contain a definition of a requested class
+///
+/// This is a cheap textual scan: a source is selected if it or any header it
+/// transitively includes mentions the unqualified name of one of the classes.
+/// Includes are resolved against the include paths of the compile command;
+/// headers which cannot be found that way (e.g. from the implicit system
+/// include paths) are not scanned.
+///
+/// @param ClassNames the requested, possibly qualified, class names
+std::vector<std::string>
+prefilterSources(const clang::tooling::CompilationDatabase &Compilations,
+                 const std::vector<std::string> &Sources,
+                 const std::vector<std::string> &ClassNames);
+
+#endif // PREFILTER_H
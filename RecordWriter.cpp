@@ -0,0 +1,91 @@
+#include "RecordWriter.h"
+
+#include <utility>
+
+#include "Storage.h"
+#include "Stats.h"
+
+RecordWriter::RecordWriter(const Storage &Db, size_t Capacity)
+    : Db(Db), Capacity(Capacity), Thread([this]() { run(); }) {}
+
+RecordWriter::~RecordWriter() { finish(); }
+
+void RecordWriter::push(RecordBatch Batch) {
+  std::unique_lock<std::mutex> Lock(Mutex);
+  NotFull.wait(Lock, [this]() { return Queue.size() < Capacity; });
+  Queue.emplace_back(std::move(Batch));
+  Lock.unlock();
+  NotEmpty.notify_one();
+}
+
+void RecordWriter::finish() {
+  {
+    std::lock_guard<std::mutex> Lock(Mutex);
+    Done = true;
+  }
+  NotEmpty.notify_one();
+
+  if (Thread.joinable())
+    Thread.join();
+}
+
+void RecordWriter::run() {
+  const ThreadTrace Trace;
+  std::deque<RecordBatch> Pending;
+
+  // all records go into one bulk load transaction which a database commits in
+  // chunks of its configured batch size
+  Db.begin();
+
+  while (true) {
+    {
+      std::unique_lock<std::mutex> Lock(Mutex);
+      NotEmpty.wait(Lock, [this]() { return Done or not Queue.empty(); });
+      if (Queue.empty())
+        break; // done and drained
+      std::swap(Pending, Queue);
+    }
+    NotFull.notify_all();
+
+    const PhaseTimer Timer(Phase::Write);
+    for (const auto &Batch : Pending)
+      write(Batch);
+
+    Pending.clear();
+  }
+
+  Db.commit();
+}
+
+void RecordWriter::write(const RecordBatch &Batch) const {
+  for (const auto &Class : Batch.Classes) {
+    Db.insertClass(Class.Name, Class.Namespace, Class.File);
+
+    if (Class.IsTemplateInstance)
+      Db.insertTemplateInstance(Class.Name, Class.Template, Class.TemplateArgs,
+                                Class.File);
+
+    for (const auto &Used : Class.Uses)
+      Db.insertUses(Class.Name, Used, Class.File);
+
+    for (const auto &Method : Class.Methods)
+      Db.insertMethod(Class.Name, Method.Name, Method.Returns,
+                      Method.Parameters, Method.Access, Method.IsStatic,
+                      Method.IsAbstract, Class.File);
+
+    for (const auto &Field : Class.Fields)
+      Db.insertOwns(Class.Name, Field.Type, Field.Name, Class.File);
+  }
+
+  for (const auto &Edge : Batch.Inheritance)
+    Db.insertInheritance(Edge.Derived, Edge.Base, Edge.File);
+
+  for (const auto &Counted : Batch.CountedInstances)
+    for (const auto &Instance : Counted.Instances)
+      Db.insertCountedInstance(Counted.Template, Counted.Namespace,
+                               Instance.first, Instance.second);
+
+  for (const auto &Unit : Batch.TranslationUnits)
+    Db.insertTranslationUnit(Unit.Path, static_cast<int64_t>(Unit.CommandHash),
+                             Unit.Dependencies, Unit.Cost);
+}
@@ -0,0 +1,52 @@
+#ifndef RECORDWRITER_H
+#define RECORDWRITER_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#include "Records.h"
+
+class Storage;
+
+/// single writer draining extracted records into storage
+///
+/// AST callbacks on any number of threads `push` batches into a bounded
+/// queue; a dedicated thread takes everything queued so far and writes it in
+/// one transaction, so parsing and storage overlap and only one thread ever
+/// writes to the storage.
+class RecordWriter {
+public:
+  /// @param Capacity number of batches buffered before producers block
+  explicit RecordWriter(const Storage &Db, size_t Capacity = 1024);
+
+  ~RecordWriter();
+
+  RecordWriter(const RecordWriter &) = delete;
+  RecordWriter &operator=(const RecordWriter &) = delete;
+
+  /// hand a batch to the writer, blocking while the queue is full
+  void push(RecordBatch Batch);
+
+  /// write all pending records and stop the writer thread
+  void finish();
+
+private:
+  void run();
+  void write(const RecordBatch &Batch) const;
+
+  const Storage &Db;
+  const size_t Capacity;
+
+  std::mutex Mutex;
+  std::condition_variable NotEmpty;
+  std::condition_variable NotFull;
+  std::deque<RecordBatch> Queue;
+  bool Done = false;
+
+  std::thread Thread;
+};
+
+#endif // RECORDWRITER_H
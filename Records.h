@@ -0,0 +1,86 @@
+#ifndef RECORDS_H
+#define RECORDS_H
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+/// a method of a recorded class
+struct MethodRecord {
+  std::string Name;
+  std::string Returns;
+  std::string Parameters;
+  int Access;
+  bool IsStatic;
+  bool IsAbstract;
+};
+
+/// a member variable of class type
+struct FieldRecord {
+  std::string Type;
+  std::string Name;
+};
+
+/// everything extracted from a single class definition
+struct ClassRecord {
+  std::string Name;
+  std::string Namespace;
+  /// file containing the definition, or the point of instantiation of
+  /// instantiations, if tracked
+  std::string File;
+
+  /// set for instantiations of class templates
+  bool IsTemplateInstance = false;
+  std::string Template;
+  std::string TemplateArgs;
+
+  std::vector<MethodRecord> Methods;
+  std::vector<FieldRecord> Fields;
+  std::vector<std::string> Uses;
+};
+
+/// a direct base relationship
+struct InheritanceRecord {
+  std::string Derived;
+  std::string Base;
+  /// file the derived class is recorded from, if tracked
+  std::string File;
+};
+
+/// what parsing a translation unit took, to schedule later runs by
+struct TranslationUnitCost {
+  /// memory held by the parse at its end, in bytes
+  int64_t Memory = 0;
+  /// wall time of the parse in milliseconds
+  int64_t Milliseconds = 0;
+};
+
+/// a parsed translation unit, tracked for incremental runs
+struct TranslationUnitRecord {
+  std::string Path;
+  uint64_t CommandHash;
+  /// all files read, with a hash of their contents
+  std::vector<std::pair<std::string, int64_t>> Dependencies;
+  TranslationUnitCost Cost;
+};
+
+/// the distinct instantiations of a class template seen in a run which
+/// records some instantiations as their template
+struct CountedInstancesRecord {
+  std::string Template;
+  std::string Namespace;
+  /// a hash of the name of every instantiation, with whether it was recorded
+  /// as its template
+  std::vector<std::pair<int64_t, bool>> Instances;
+};
+
+/// records produced by a single match, handed to the writer as one unit
+struct RecordBatch {
+  std::vector<ClassRecord> Classes;
+  std::vector<InheritanceRecord> Inheritance;
+  std::vector<TranslationUnitRecord> TranslationUnits;
+  std::vector<CountedInstancesRecord> CountedInstances;
+};
+
+#endif // RECORDS_H
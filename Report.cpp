@@ -1,178 +1,725 @@
 #include "Report.h"
 
-#include <cassert>
 #include <cstddef>
+#include <cstdint>
+#include <optional>
 #include <string>
-#include <vector>
+#include <utility>
 
 #include "clang/Basic/Specifiers.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/ADT/StringSwitch.h"
+#include "llvm/ADT/Twine.h"
+#include "llvm/Support/JSON.h"
 #include "llvm/Support/raw_ostream.h"
 
-#include "DB.h"
+#include "Storage.h"
 
-enum ReportType { dot, plantuml };
-
-template <ReportType> void reportBegin(const DB &, const ReportKind &Kind) {}
-template <ReportType> void reportEnd(const DB &, const ReportKind &Kind) {}
-template <ReportType> void reportClasses(const DB &, const ReportKind &Kind) {}
 template <ReportType>
-void reportInheritance(const DB &, const ReportKind &Kind) {}
-
-template <> void reportBegin<plantuml>(const DB &, const ReportKind &Kind) {
-  llvm::outs() << "@startuml\n\n"
-                  "skinparam class {\n"
-                  "  BackgroundColor White\n"
-                  "  ArrowColor Black\n"
-                  "  BorderColor DimGrey\n"
-                  "}\n"
-                  "hide circle\n"
-                  "hide empty attributes\n\n";
-}
-template <> void reportEnd<plantuml>(const DB &, const ReportKind &Kind) {
-  llvm::outs() << "\n@enduml\n";
-}
-template <> void reportClasses<plantuml>(const DB &Db, const ReportKind &Kind) {
-  Db.execute("SELECT DISTINCT namespace FROM classes");
-  const auto NamespaceRows = Db.rows;
-
-  for (size_t I = 0; I < NamespaceRows.size(); ++I) {
-    const auto &Ns = NamespaceRows[I][0];
-    if (not Db.execute("SELECT name FROM classes WHERE namespace = '" + Ns +
-                       "'"))
+void reportBegin(const Storage &, const ReportKind &Kind,
+                 llvm::raw_ostream &OS) {}
+template <ReportType>
+void reportEnd(const Storage &, const ReportKind &Kind,
+               llvm::raw_ostream &OS) {}
+template <ReportType>
+bool reportClasses(const Storage &, const ReportKind &Kind,
+                   llvm::raw_ostream &OS) {
+  return true;
+}
+template <ReportType>
+bool reportInheritance(const Storage &, const ReportKind &Kind,
+                       llvm::raw_ostream &OS) {
+  return true;
+}
+
+namespace {
+/// the UML visibility marker for @p Access
+llvm::StringRef accessSymbol(int Access) {
+  switch (Access) {
+  case clang::AS_public:
+    return "+";
+  case clang::AS_private:
+    return "-";
+  case clang::AS_protected:
+    return "#";
+  default:
+    return "";
+  }
+}
+
+/// the name of @p Access for structured formats
+llvm::StringRef accessName(int Access) {
+  switch (Access) {
+  case clang::AS_public:
+    return "public";
+  case clang::AS_private:
+    return "private";
+  case clang::AS_protected:
+    return "protected";
+  default:
+    return "none";
+  }
+}
+
+/// the return type shown for a method; `void` is omitted
+llvm::StringRef shownReturnType(llvm::StringRef Returns) {
+  return Returns == "void" ? llvm::StringRef() : Returns;
+}
+
+/// write the comma separating array elements unless @p First
+void writeSeparator(llvm::raw_ostream &OS, bool &First) {
+  OS << (First ? "\n" : ",\n");
+  First = false;
+}
+
+/// calls a function for every template instance visited
+template <typename Callback>
+class TemplateInstanceVisitor : public ReportVisitor {
+public:
+  explicit TemplateInstanceVisitor(Callback Visit) : Visit(std::move(Visit)) {}
+
+  void visitTemplateInstance(llvm::StringRef Instance, llvm::StringRef Tmpl,
+                             llvm::StringRef TemplateArgs) override {
+    Visit(Instance, Tmpl, TemplateArgs);
+  }
+
+private:
+  Callback Visit;
+};
+
+/// calls a function for every inheritance edge visited
+template <typename Callback>
+class InheritanceVisitor : public ReportVisitor {
+public:
+  explicit InheritanceVisitor(Callback Visit) : Visit(std::move(Visit)) {}
+
+  void visitInheritance(llvm::StringRef Derived,
+                        llvm::StringRef Base) override {
+    Visit(Derived, Base);
+  }
+
+private:
+  Callback Visit;
+};
+
+/// stream the template instances to report to @p Visit
+template <typename Callback>
+bool visitTemplateInstances(const Storage &Store, const ReportKind &Kind,
+                            Callback Visit) {
+  TemplateInstanceVisitor<Callback> Visitor(std::move(Visit));
+  return Store.visitTemplateInstances(Kind, Visitor);
+}
+
+/// stream the inheritance edges to report to @p Visit
+template <typename Callback>
+bool visitInheritance(const Storage &Store, const ReportKind &Kind,
+                      Callback Visit) {
+  InheritanceVisitor<Callback> Visitor(std::move(Visit));
+  return Store.visitInheritance(Kind, Visitor);
+}
+
+/// @p Kind with only the relations of classes given enabled
+ReportKind withRelations(const ReportKind &Kind, bool Methods, bool Owns,
+                         bool Uses) {
+  auto Pass = Kind;
+  Pass.DocumentMethods = Methods;
+  Pass.DocumentOwns = Owns;
+  Pass.DocumentUses = Uses;
+  return Pass;
+}
+
+/// writes the class blocks of a PlantUML report, each followed by its owns
+/// and uses relations
+class PlantUMLClasses : public ReportVisitor {
+public:
+  explicit PlantUMLClasses(llvm::raw_ostream &OS) : OS(OS) {}
+
+  void visitClass(llvm::StringRef Name, llvm::StringRef Ns,
+                  int64_t Instances) override {
+    closeClass();
+    Class = Name;
+    OS << "class \"" << Name << "\" {\n";
+    // instantiations recorded as their template
+    if (Instances)
+      OS << "  .. " << Instances << " instances ..\n";
+    Open = true;
+  }
+
+  void visitMethod(llvm::StringRef Name, llvm::StringRef Returns,
+                   llvm::StringRef Parameters, int Access, bool IsStatic,
+                   bool IsAbstract) override {
+    const llvm::StringRef Static = IsStatic ? "{static}" : "";
+    const llvm::StringRef Abstract = IsAbstract ? "{abstract}" : "";
+    OS << "  " << accessSymbol(Access) << shownReturnType(Returns) << " "
+       << Name << "(" << Parameters << ")"
+       << " " << Static << Abstract << "\n";
+  }
+
+  void visitOwns(llvm::StringRef Object, llvm::StringRef Name) override {
+    closeClass();
+    OS << "\"" << Class << "\" *-- \"" << Object << "\" : \"" << Name
+       << "\"\n";
+  }
+
+  void visitUses(llvm::StringRef Object) override {
+    closeClass();
+    OS << "\"" << Class << "\" --> \"" << Object << "\"\n";
+  }
+
+  /// end the block of the class visited last, if still open
+  void closeClass() {
+    if (Open)
+      OS << "}\n";
+    Open = false;
+  }
+
+private:
+  llvm::raw_ostream &OS;
+  llvm::StringRef Class;
+  bool Open = false;
+};
+
+/// writes the nodes of a dot report, clustered by namespace
+class DotNodes : public ReportVisitor {
+public:
+  explicit DotNodes(llvm::raw_ostream &OS) : OS(OS) {}
+
+  void visitClass(llvm::StringRef Name, llvm::StringRef Ns,
+                  int64_t Instances) override {
+    if (Cluster == 0 or Namespace != Ns) {
+      if (Cluster > 0)
+        OS << "}\n";
+      Namespace = Ns.str();
+      OS << "subgraph cluster_" << Cluster++ << "{\n";
+      OS << "label = ";
+      writeQuoted(OS, Namespace);
+      OS << "\n";
+    }
+
+    writeQuoted(OS, Name);
+    if (Instances) {
+      OS << " [label=";
+      writeQuoted(OS, (Name + " (" + llvm::Twine(Instances) + " instances)")
+                          .str());
+      OS << "]";
+    }
+    OS << ";\n";
+  }
+
+  /// end the last cluster
+  void finish() {
+    if (Cluster > 0)
+      OS << "}\n";
+  }
+
+private:
+  llvm::raw_ostream &OS;
+  size_t Cluster = 0;
+  std::string Namespace;
+};
+
+/// writes the owns and uses edges of a dot report
+class DotRelations : public ReportVisitor {
+public:
+  explicit DotRelations(llvm::raw_ostream &OS) : OS(OS) {}
+
+  void visitClass(llvm::StringRef Name, llvm::StringRef, int64_t) override {
+    Class = Name;
+  }
+
+  void visitOwns(llvm::StringRef Object, llvm::StringRef Name) override {
+    writeQuoted(OS, Class);
+    OS << " -> ";
+    writeQuoted(OS, Object);
+    OS << " [arrowtail=diamond, dir=back, label=";
+    writeQuoted(OS, Name);
+    OS << "]\n";
+  }
+
+  void visitUses(llvm::StringRef Object) override {
+    writeQuoted(OS, Class);
+    OS << " -> ";
+    writeQuoted(OS, Object);
+    OS << " [style=dashed]\n";
+  }
+
+private:
+  llvm::raw_ostream &OS;
+  llvm::StringRef Class;
+};
+
+/// writes the elements of the array of classes of a JSON report
+///
+/// Each class is an object with an array per enabled relation, filled as its
+/// relations are visited.
+class JSONClasses : public ReportVisitor {
+public:
+  JSONClasses(const ReportKind &Kind, llvm::raw_ostream &OS)
+      : Enabled{Kind.DocumentMethods, Kind.DocumentOwns, Kind.DocumentUses},
+        OS(OS) {}
+
+  void visitClass(llvm::StringRef Name, llvm::StringRef Ns,
+                  int64_t Instances) override {
+    closeClass();
+    writeSeparator(OS, First);
+
+    J.emplace(OS);
+    J->objectBegin();
+    J->attribute("name", Name);
+    J->attribute("namespace", Ns);
+    if (Instances)
+      J->attribute("instances", Instances);
+    Section = -1;
+  }
+
+  void visitMethod(llvm::StringRef Name, llvm::StringRef Returns,
+                   llvm::StringRef Parameters, int Access, bool IsStatic,
+                   bool IsAbstract) override {
+    enter(Methods);
+    J->object([&]() {
+      J->attribute("name", Name);
+      J->attribute("returns", Returns);
+      J->attribute("parameters", Parameters);
+      J->attribute("access", accessName(Access));
+      J->attribute("static", IsStatic);
+      J->attribute("abstract", IsAbstract);
+    });
+  }
+
+  void visitOwns(llvm::StringRef Object, llvm::StringRef Name) override {
+    enter(Owns);
+    J->object([&]() {
+      J->attribute("type", Object);
+      J->attribute("name", Name);
+    });
+  }
+
+  void visitUses(llvm::StringRef Object) override {
+    enter(Uses);
+    J->value(Object);
+  }
+
+  /// end the object of the class visited last, if still open
+  void closeClass() {
+    if (not J)
       return;
-    const auto ClassRows = Db.rows;
-    for (const auto &Row : ClassRows) {
-      const auto &Class = Row[0];
-      llvm::outs() << "class \"" + Class + "\" {\n";
-
-      if (Kind.DocumentMethods) {
-        Db.execute("SELECT name, parameters, returns, access, static, abstract "
-                   "FROM methods WHERE class='" +
-                   Class + "'");
-        for (const auto &Method : Db.rows) {
-          std::string Access = "";
-          switch (std::stoi(Method[3])) {
-          case clang::AS_public: {
-            Access = "+";
-          } break;
-          case clang::AS_private: {
-            Access = "-";
-          } break;
-          case clang::AS_protected: {
-            Access = "#";
-          } break;
-          case clang::AS_none:
-            break;
-          }
-
-          const std::string IsStatic = std::stoi(Method[4]) ? "{static}" : "";
-          const std::string IsAbstract =
-              std::stoi(Method[5]) ? "{abstract}" : "";
-          const auto Modifiers = IsStatic + IsAbstract;
-
-          const auto Returns = Method[2] == "void" ? "" : Method[2];
-          llvm::outs() << "  " + Access + Returns + " " + Method[0] + "(" +
-                              Method[1] + ")" + " " + Modifiers + "\n";
-        }
-      }
-      llvm::outs() << "}\n";
-
-      // show "owns" relationships
-      if (Kind.DocumentOwns) {
-        Db.execute("SELECT object, name FROM owns WHERE owner ='" + Class +
-                   "'");
-        for (const auto &Row : Db.rows)
-          llvm::outs() << "\"" + Class + "\" *-- \"" + Row[0] + "\" : \"" +
-                              Row[1] + "\"\n";
-      }
+    enter(End);
+    J->objectEnd();
+    J.reset();
+  }
 
-      // show "uses" relationships
-      if (Kind.DocumentUses) {
-        Db.execute("SELECT object FROM uses WHERE user ='" + Class + "'");
-        for (const auto &Row : Db.rows) {
-          llvm::outs() << "\"" + Class + "\" --> \"" + Row[0] + "\"\n";
-        }
+private:
+  /// the arrays of a class, in the order they are written
+  enum { Methods, Owns, Uses, End };
+
+  /// close the array being filled and open the enabled ones up to
+  /// @p Target, so that empty arrays are written too
+  void enter(int Target) {
+    static const char *const Names[] = {"methods", "owns", "uses"};
+    while (Section < Target) {
+      if (Section >= 0 and Enabled[Section]) {
+        J->arrayEnd();
+        J->attributeEnd();
+      }
+      if (++Section < End and Enabled[Section]) {
+        J->attributeBegin(Names[Section]);
+        J->arrayBegin();
       }
     }
+  }
 
-    // show "binds" relationships
-    if (Kind.DocumentBinds) {
-      Db.execute("SELECT DISTINCT template, template_args FROM template_inst");
-      const auto TemplateRows = Db.rows;
+  const bool Enabled[End];
+  llvm::raw_ostream &OS;
+  std::optional<llvm::json::OStream> J;
+  bool First = true;
+  /// the array being filled; -1 before the first
+  int Section = -1;
+};
 
-      for (const auto &Template : TemplateRows) {
-        llvm::outs() << "class \"" + Template[0] + "\"<" + Template[1] +
-                            "> {\n}\n";
+/// writes the nodes and edges of a GraphML report
+///
+/// Nodes are identified by the class name, as relations are; a name shared by
+/// classes in several namespaces is a single node carrying the first
+/// namespace. Names only referred to by relations get a node without a
+/// namespace before their first edge.
+class GraphMLWriter : public ReportVisitor {
+public:
+  explicit GraphMLWriter(llvm::raw_ostream &OS) : OS(OS) {}
 
-        Db.execute("SELECT instance FROM template_inst WHERE template = '" +
-                   Template[0] + "'");
-        for (const auto &Row : Db.rows) {
-          llvm::outs() << "\"" + Row[0] + "\" ..|> \"" + Template[0] +
-                              "\" : <<bind>>\n";
-        }
-      }
+  void visitClass(llvm::StringRef Name, llvm::StringRef Ns,
+                  int64_t Instances) override {
+    closeNode();
+    Class = Name;
+
+    // in the pass writing relations, classes are declared already
+    if (not Nodes.try_emplace(Name, Nodes.size()).second)
+      return;
+    OS << "<node id=\"n" << Nodes.lookup(Name) << "\"><data key=\"name\">";
+    llvm::printHTMLEscaped(Name, OS);
+    OS << "</data><data key=\"namespace\">";
+    llvm::printHTMLEscaped(Ns, OS);
+    OS << "</data>";
+    if (Instances)
+      OS << "<data key=\"instances\">" << Instances << "</data>";
+    Open = true;
+  }
+
+  void visitMethod(llvm::StringRef Name, llvm::StringRef Returns,
+                   llvm::StringRef Parameters, int Access, bool IsStatic,
+                   bool IsAbstract) override {
+    if (not Open)
+      return;
+    if (not InMethods)
+      OS << "<data key=\"methods\">";
+    InMethods = true;
+
+    OS << accessSymbol(Access);
+    llvm::printHTMLEscaped(shownReturnType(Returns), OS);
+    OS << " ";
+    llvm::printHTMLEscaped(Name, OS);
+    OS << "(";
+    llvm::printHTMLEscaped(Parameters, OS);
+    OS << ")" << (IsStatic ? " {static}" : "")
+       << (IsAbstract ? " {abstract}" : "") << "&#10;";
+  }
+
+  void visitOwns(llvm::StringRef Object, llvm::StringRef Name) override {
+    edge(Class, Object, "owns", Name);
+  }
+
+  void visitUses(llvm::StringRef Object) override {
+    edge(Class, Object, "uses");
+  }
+
+  void visitTemplateInstance(llvm::StringRef Instance, llvm::StringRef Tmpl,
+                             llvm::StringRef TemplateArgs) override {
+    edge(Instance, Tmpl, "binds", TemplateArgs);
+  }
+
+  void visitInheritance(llvm::StringRef Derived,
+                        llvm::StringRef Base) override {
+    edge(Derived, Base, "inherits");
+  }
+
+  /// end the node of the class visited last, if still open
+  void closeNode() {
+    if (InMethods)
+      OS << "</data>";
+    if (Open)
+      OS << "</node>\n";
+    Open = InMethods = false;
+  }
+
+private:
+  /// the id of the node named @p Name, declaring it if needed
+  size_t node(llvm::StringRef Name) {
+    const auto Inserted = Nodes.try_emplace(Name, Nodes.size());
+    if (Inserted.second) {
+      OS << "<node id=\"n" << Inserted.first->second
+         << "\"><data key=\"name\">";
+      llvm::printHTMLEscaped(Name, OS);
+      OS << "</data></node>\n";
+    }
+    return Inserted.first->second;
+  }
+
+  void edge(llvm::StringRef Source, llvm::StringRef Target,
+            llvm::StringRef Kind, llvm::StringRef Label = "") {
+    const auto SourceId = node(Source);
+    const auto TargetId = node(Target);
+
+    OS << "<edge source=\"n" << SourceId << "\" target=\"n" << TargetId
+       << "\"><data key=\"kind\">" << Kind << "</data>";
+    if (not Label.empty()) {
+      OS << "<data key=\"label\">";
+      llvm::printHTMLEscaped(Label, OS);
+      OS << "</data>";
     }
+    OS << "</edge>\n";
+  }
+
+  llvm::raw_ostream &OS;
+  /// node ids by name, in the order nodes were declared
+  llvm::StringMap<size_t> Nodes;
+  llvm::StringRef Class;
+  bool Open = false;
+  bool InMethods = false;
+};
+} // namespace
+
+void writeQuoted(llvm::raw_ostream &OS, llvm::StringRef S) {
+  OS << '"';
+  for (const auto C : S) {
+    if (C == '"' or C == '\\')
+      OS << '\\';
+    OS << C;
   }
+  OS << '"';
+}
+
+void writePlantUMLBegin(llvm::raw_ostream &OS) {
+  OS << "@startuml\n\n"
+        "skinparam class {\n"
+        "  BackgroundColor White\n"
+        "  ArrowColor Black\n"
+        "  BorderColor DimGrey\n"
+        "}\n"
+        "hide circle\n"
+        "hide empty attributes\n\n";
+}
+
+void writePlantUMLEnd(llvm::raw_ostream &OS) { OS << "\n@enduml\n"; }
+
+std::optional<ReportType> reportType(llvm::StringRef Name) {
+  return llvm::StringSwitch<std::optional<ReportType>>(Name)
+      .Case("plantuml", plantuml)
+      .Case("dot", dot)
+      .Case("json", json)
+      .Case("graphml", graphml)
+      .Default(std::nullopt);
 }
 
 template <>
-void reportInheritance<plantuml>(const DB &Db, const ReportKind &Kind) {
-  if (not Db.execute("SELECT derived, base FROM inheritance"))
-    return;
-  for (const auto &Row : Db.rows) {
-    assert(Row.size() == 2);
-    llvm::outs() << "\"" + Row[0] << "\" --|> \"" << Row[1] << "\"\n";
-  }
+void reportBegin<plantuml>(const Storage &, const ReportKind &Kind,
+                           llvm::raw_ostream &OS) {
+  writePlantUMLBegin(OS);
 }
+template <>
+void reportEnd<plantuml>(const Storage &, const ReportKind &Kind,
+                         llvm::raw_ostream &OS) {
+  writePlantUMLEnd(OS);
+}
+
+template <>
+bool reportClasses<plantuml>(const Storage &Store, const ReportKind &Kind,
+                             llvm::raw_ostream &OS) {
+  PlantUMLClasses Classes(OS);
+  if (not Store.visitClasses(Kind, Classes))
+    return false;
+  Classes.closeClass();
+
+  // show "binds" relationships
+  if (not Kind.DocumentBinds)
+    return true;
+  std::optional<std::pair<std::string, std::string>> Previous;
+  return visitTemplateInstances(
+      Store, Kind,
+      [&](llvm::StringRef Instance, llvm::StringRef Tmpl,
+          llvm::StringRef TemplateArgs) {
+        if (not Previous or Previous->first != Tmpl or
+            Previous->second != TemplateArgs) {
+          Previous.emplace(Tmpl.str(), TemplateArgs.str());
+          OS << "class \"" << Tmpl << "\"<" << TemplateArgs << "> {\n}\n";
+        }
 
-template <> void reportBegin<dot>(const DB &, const ReportKind &Kind) {
-  llvm::outs() << "digraph G {\n";
+        OS << "\"" << Instance << "\" ..|> \"" << Tmpl << "\" : <<bind>>\n";
+      });
 }
 
-template <> void reportEnd<dot>(const DB &, const ReportKind &Kind) {
-  llvm::outs() << "}\n";
+template <>
+bool reportInheritance<plantuml>(const Storage &Store, const ReportKind &Kind,
+                                 llvm::raw_ostream &OS) {
+  return visitInheritance(Store, Kind,
+                          [&OS](llvm::StringRef Derived, llvm::StringRef Base) {
+                            OS << "\"" << Derived << "\" --|> \"" << Base
+                               << "\"\n";
+                          });
 }
 
-template <> void reportInheritance<dot>(const DB &Db, const ReportKind &Kind) {
-  if (not Db.execute("SELECT derived, base FROM inheritance"))
-    return;
+template <>
+void reportBegin<dot>(const Storage &, const ReportKind &Kind,
+                      llvm::raw_ostream &OS) {
+  OS << "digraph G {\n";
+}
 
-  for (const auto &Row : Db.rows) {
-    assert(Row.size() == 2);
+template <>
+void reportEnd<dot>(const Storage &, const ReportKind &Kind,
+                    llvm::raw_ostream &OS) {
+  OS << "}\n";
+}
 
-    llvm::outs() << Row[0] << " -> " << Row[1] << "\n";
-  }
+template <>
+bool reportInheritance<dot>(const Storage &Store, const ReportKind &Kind,
+                            llvm::raw_ostream &OS) {
+  return visitInheritance(Store, Kind,
+                          [&OS](llvm::StringRef Derived, llvm::StringRef Base) {
+                            writeQuoted(OS, Derived);
+                            OS << " -> ";
+                            writeQuoted(OS, Base);
+                            OS << "\n";
+                          });
 }
 
-template <> void reportClasses<dot>(const DB &Db, const ReportKind &Kind) {
-  if (not Db.execute("SELECT DISTINCT namespace FROM classes"))
-    return;
+template <>
+bool reportClasses<dot>(const Storage &Store, const ReportKind &Kind,
+                        llvm::raw_ostream &OS) {
+  // nodes are declared in clusters, which must not hold the edges, so
+  // classes are visited twice
+  DotNodes Nodes(OS);
+  if (not Store.visitClasses(withRelations(Kind, false, false, false), Nodes))
+    return false;
+  Nodes.finish();
 
-  const auto NamespaceRows = Db.rows;
+  DotRelations Relations(OS);
+  if ((Kind.DocumentOwns or Kind.DocumentUses) and
+      not Store.visitClasses(
+          withRelations(Kind, false, Kind.DocumentOwns, Kind.DocumentUses),
+          Relations))
+    return false;
 
-  for (size_t I = 0; I < NamespaceRows.size(); ++I) {
-    const auto &Ns = NamespaceRows[I][0];
-    llvm::outs() << "subgraph cluster_" << std::to_string(I) << "{\n";
-    llvm::outs() << "label = \"" << Ns << "\"\n";
-    if (not Db.execute("SELECT name FROM classes WHERE namespace = '" + Ns +
-                       "'"))
-      return;
-    for (const auto &Row : Db.rows) {
-      const auto &Class = Row[0];
-      llvm::outs() << Class << ";\n";
-    }
+  if (not Kind.DocumentBinds)
+    return true;
+  return visitTemplateInstances(Store, Kind,
+                                [&OS](llvm::StringRef Instance,
+                                      llvm::StringRef Tmpl,
+                                      llvm::StringRef TemplateArgs) {
+                                  writeQuoted(OS, Instance);
+                                  OS << " -> ";
+                                  writeQuoted(OS, Tmpl);
+                                  OS << " [style=dotted, label=";
+                                  writeQuoted(OS, TemplateArgs);
+                                  OS << "]\n";
+                                });
+}
 
-    llvm::outs() << "}\n";
-  }
+// JSON reports are a single object with arrays of classes, template
+// instances and inheritance edges; each element is written as it is visited
+template <>
+void reportBegin<json>(const Storage &, const ReportKind &Kind,
+                       llvm::raw_ostream &OS) {
+  OS << "{";
+}
+
+template <>
+void reportEnd<json>(const Storage &, const ReportKind &Kind,
+                     llvm::raw_ostream &OS) {
+  OS << "\n}\n";
+}
+
+template <>
+bool reportClasses<json>(const Storage &Store, const ReportKind &Kind,
+                         llvm::raw_ostream &OS) {
+  OS << "\n\"classes\": [";
+  JSONClasses Classes(Kind, OS);
+  if (not Store.visitClasses(Kind, Classes))
+    return false;
+  Classes.closeClass();
+  OS << "\n]";
+
+  if (not Kind.DocumentBinds)
+    return true;
+  OS << ",\n\"templateInstances\": [";
+  bool First = true;
+  const auto Visited = visitTemplateInstances(
+      Store, Kind,
+      [&](llvm::StringRef Instance, llvm::StringRef Tmpl,
+          llvm::StringRef TemplateArgs) {
+        writeSeparator(OS, First);
+
+        llvm::json::OStream J(OS);
+        J.object([&]() {
+          J.attribute("instance", Instance);
+          J.attribute("template", Tmpl);
+          J.attribute("arguments", TemplateArgs);
+        });
+      });
+  OS << "\n]";
+  return Visited;
+}
+
+template <>
+bool reportInheritance<json>(const Storage &Store, const ReportKind &Kind,
+                             llvm::raw_ostream &OS) {
+  OS << ",\n\"inheritance\": [";
+  bool First = true;
+  const auto Visited = visitInheritance(
+      Store, Kind, [&](llvm::StringRef Derived, llvm::StringRef Base) {
+        writeSeparator(OS, First);
+
+        llvm::json::OStream J(OS);
+        J.object([&]() {
+          J.attribute("derived", Derived);
+          J.attribute("base", Base);
+        });
+      });
+  OS << "\n]";
+  return Visited;
+}
+
+template <>
+void reportBegin<graphml>(const Storage &, const ReportKind &Kind,
+                          llvm::raw_ostream &OS) {
+  OS << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+        "<graphml xmlns=\"http://graphml.graphdrawing.org/xmlns\">\n"
+        "<key id=\"name\" for=\"node\" attr.name=\"name\" "
+        "attr.type=\"string\"/>\n"
+        "<key id=\"namespace\" for=\"node\" attr.name=\"namespace\" "
+        "attr.type=\"string\"/>\n"
+        "<key id=\"methods\" for=\"node\" attr.name=\"methods\" "
+        "attr.type=\"string\"/>\n"
+        "<key id=\"instances\" for=\"node\" attr.name=\"instances\" "
+        "attr.type=\"long\"/>\n"
+        "<key id=\"kind\" for=\"edge\" attr.name=\"kind\" "
+        "attr.type=\"string\"/>\n"
+        "<key id=\"label\" for=\"edge\" attr.name=\"label\" "
+        "attr.type=\"string\"/>\n"
+        "<graph id=\"G\" edgedefault=\"directed\">\n";
+}
+
+template <>
+void reportEnd<graphml>(const Storage &, const ReportKind &Kind,
+                        llvm::raw_ostream &OS) {
+  OS << "</graph>\n</graphml>\n";
+}
+
+template <>
+bool reportClasses<graphml>(const Storage &Store, const ReportKind &Kind,
+                            llvm::raw_ostream &OS) {
+  // all classes first so that they are not declared by an edge; inheritance
+  // is written here too, as its ends may need declaring
+  GraphMLWriter Writer(OS);
+  if (not Store.visitClasses(
+          withRelations(Kind, Kind.DocumentMethods, false, false), Writer))
+    return false;
+  Writer.closeNode();
+
+  if ((Kind.DocumentOwns or Kind.DocumentUses) and
+      not Store.visitClasses(
+          withRelations(Kind, false, Kind.DocumentOwns, Kind.DocumentUses),
+          Writer))
+    return false;
+
+  if (Kind.DocumentBinds and not Store.visitTemplateInstances(Kind, Writer))
+    return false;
+
+  return Store.visitInheritance(Kind, Writer);
 }
 
-template <ReportType T> void report(const DB &Db, const ReportKind &Kind) {
-  reportBegin<T>(Db, Kind);
-  reportClasses<T>(Db, Kind);
-  reportInheritance<T>(Db, Kind);
-  reportEnd<T>(Db, Kind);
+template <ReportType T>
+void report(const Storage &Store, const ReportKind &Kind,
+            llvm::raw_ostream &OS) {
+  if (not Store.selectReport(Kind))
+    return;
+
+  // an incomplete report is left unterminated
+  reportBegin<T>(Store, Kind, OS);
+  if (reportClasses<T>(Store, Kind, OS) and
+      reportInheritance<T>(Store, Kind, OS))
+    reportEnd<T>(Store, Kind, OS);
 }
 
-void report(const DB &Db, const ReportKind &Kind) {
-  return report<plantuml>(Db, Kind);
+void report(const Storage &Store, const ReportKind &Kind,
+            llvm::raw_ostream &OS) {
+  switch (Kind.Type) {
+  case dot:
+    return report<dot>(Store, Kind, OS);
+  case plantuml:
+    return report<plantuml>(Store, Kind, OS);
+  case json:
+    return report<json>(Store, Kind, OS);
+  case graphml:
+    return report<graphml>(Store, Kind, OS);
+  }
 }
@@ -1,15 +1,52 @@
 #ifndef REPORT_H
 #define REPORT_H
 
-class DB;
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "llvm/ADT/StringRef.h"
+
+class Storage;
+
+namespace llvm {
+class raw_ostream;
+} // namespace llvm
+
+/// the formats reports are written in
+enum ReportType { dot, plantuml, json, graphml };
+
+/// the report format called @p Name, as given with `-format`
+std::optional<ReportType> reportType(llvm::StringRef Name);
 
 struct ReportKind {
   bool DocumentOwns;
   bool DocumentUses;
   bool DocumentBinds;
   bool DocumentMethods;
+
+  ReportType Type = plantuml;
+
+  /// classes to start from when reporting only a neighbourhood
+  std::vector<std::string> Roots;
+  /// number of relations to follow from `Roots`; negative reports everything
+  int Depth = -1;
+
+  /// whether only the neighbourhood of `Roots` is reported
+  bool scoped() const { return Depth >= 0 and not Roots.empty(); }
 };
 
-void report(const DB &Db, const ReportKind &Kind);
+/// write a description of the classes in @p Store to @p OS
+void report(const Storage &Store, const ReportKind &Kind,
+            llvm::raw_ostream &OS);
+
+/// write @p S as a double-quoted dot ID
+void writeQuoted(llvm::raw_ostream &OS, llvm::StringRef S);
+
+/// write the start of a PlantUML diagram with the style of all reports
+void writePlantUMLBegin(llvm::raw_ostream &OS);
+
+/// write the end of a PlantUML diagram
+void writePlantUMLEnd(llvm::raw_ostream &OS);
 
 #endif // REPORT_H
@@ -0,0 +1,306 @@
+#include "Server.h"
+
+#include <cerrno>
+#include <csignal>
+#include <cstddef>
+#include <cstring>
+#include <utility>
+
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/ADT/StringSet.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "DB.h"
+
+namespace {
+/// time without further changes after which an update starts
+constexpr int SettleMilliseconds = 50;
+
+/// longest request line accepted
+constexpr size_t MaxRequestSize = 64 * 1024;
+
+/// watches the files read by recorded translation units for changes
+class Watcher {
+public:
+  Watcher() : Fd(inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) {}
+
+  ~Watcher() {
+    if (Fd >= 0)
+      close(Fd);
+  }
+
+  Watcher(const Watcher &) = delete;
+  Watcher &operator=(const Watcher &) = delete;
+
+  int fd() const { return Fd; }
+
+  /// watch the directories of all files recorded as dependencies in @p Db
+  ///
+  /// Files are watched through their directories so that editors replacing
+  /// a file by renaming a new one over it are noticed as well.
+  void watchDependencies(const DB &Db) {
+    for (auto Files = Db.query("SELECT DISTINCT f.path FROM dependencies d "
+                               "JOIN files f ON f.id = d.file");
+         Files.next();) {
+      const auto Path = Files.text(0);
+      if (not Dependencies.insert(Path).second)
+        continue;
+
+      const auto Directory = llvm::sys::path::parent_path(Path);
+      if (not Directories.insert(Directory).second)
+        continue;
+
+      const auto Wd =
+          inotify_add_watch(Fd, Directory.str().c_str(),
+                            IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM |
+                                IN_DELETE);
+      if (Wd < 0) {
+        llvm::errs() << "COULD NOT WATCH " << Directory << ": "
+                     << std::strerror(errno) << "\n";
+        continue;
+      }
+      Watches[Wd] = Directory.str();
+    }
+  }
+
+  /// add the watched files changed since the last call to @p Changed
+  void readChanges(llvm::StringSet<> &Changed) {
+    alignas(inotify_event) char Buffer[4096];
+    while (true) {
+      const auto Size = read(Fd, Buffer, sizeof(Buffer));
+      if (Size <= 0)
+        return;
+
+      for (auto Offset = 0L; Offset < Size;) {
+        const auto *const Event =
+            reinterpret_cast<const inotify_event *>(Buffer + Offset);
+        Offset += sizeof(inotify_event) + Event->len;
+
+        if (Event->mask & IN_Q_OVERFLOW) {
+          // events were lost, so anything may have changed
+          for (const auto &Dependency : Dependencies)
+            Changed.insert(Dependency.getKey());
+          continue;
+        }
+
+        const auto Directory = Watches.find(Event->wd);
+        if (Directory == Watches.end() or Event->len == 0)
+          continue;
+
+        llvm::SmallString<256> Path(Directory->second);
+        llvm::sys::path::append(Path, Event->name);
+        if (Dependencies.count(Path))
+          Changed.insert(Path);
+      }
+    }
+  }
+
+private:
+  const int Fd;
+
+  /// watched directories by watch descriptor
+  llvm::DenseMap<int, std::string> Watches;
+  llvm::StringSet<> Directories;
+  llvm::StringSet<> Dependencies;
+};
+
+/// parse a boolean request setting
+bool parseFlag(llvm::StringRef Value, bool &Flag) {
+  if (Value == "1" or Value == "true")
+    Flag = true;
+  else if (Value == "0" or Value == "false")
+    Flag = false;
+  else
+    return false;
+  return true;
+}
+
+/// apply the settings in a request line to @p Kind
+///
+/// @returns a description of the first invalid setting, or an empty string
+std::string parseRequest(llvm::StringRef Line, ReportKind &Kind) {
+  llvm::SmallVector<llvm::StringRef, 8> Settings;
+  Line.split(Settings, ' ', -1, /*KeepEmpty=*/false);
+
+  bool ClassesGiven = false;
+  for (const auto Setting : Settings) {
+    const auto KeyValue = Setting.split('=');
+    const auto Key = KeyValue.first;
+    const auto Value = KeyValue.second;
+
+    bool Valid = true;
+    if (Key == "class") {
+      // classes given in a request replace the default ones
+      if (not ClassesGiven)
+        Kind.Roots.clear();
+      ClassesGiven = true;
+      Kind.Roots.push_back(Value.str());
+    } else if (Key == "depth")
+      Valid = not Value.getAsInteger(10, Kind.Depth);
+    else if (Key == "owns")
+      Valid = parseFlag(Value, Kind.DocumentOwns);
+    else if (Key == "uses")
+      Valid = parseFlag(Value, Kind.DocumentUses);
+    else if (Key == "binds")
+      Valid = parseFlag(Value, Kind.DocumentBinds);
+    else if (Key == "methods")
+      Valid = parseFlag(Value, Kind.DocumentMethods);
+    else if (Key == "format") {
+      const auto Type = reportType(Value);
+      Valid = Type.has_value();
+      if (Valid)
+        Kind.Type = *Type;
+    } else
+      Valid = false;
+
+    if (not Valid)
+      return "invalid setting " + Setting.str();
+  }
+
+  return "";
+}
+
+/// answer the request of a connected client
+void answer(int Client, const DB &Db, const ReportKind &Defaults) {
+  // a client not sending its request must not hold up updates for long
+  timeval Timeout{1, 0};
+  setsockopt(Client, SOL_SOCKET, SO_RCVTIMEO, &Timeout, sizeof(Timeout));
+
+  std::string Request;
+  char Buffer[4096];
+  while (Request.find('\n') == std::string::npos and
+         Request.size() < MaxRequestSize) {
+    const auto Size = read(Client, Buffer, sizeof(Buffer));
+    if (Size <= 0)
+      break;
+    Request.append(Buffer, Size);
+  }
+
+  auto Kind = Defaults;
+  const auto Error =
+      parseRequest(llvm::StringRef(Request).split('\n').first.trim(), Kind);
+
+  {
+    llvm::raw_fd_ostream OS(Client, /*shouldClose=*/false);
+    if (Error.empty())
+      report(Db, Kind, OS);
+    else
+      OS << "ERROR " << Error << "\n";
+    OS.flush();
+
+    // the client may have hung up already
+    OS.clear_error();
+  }
+
+  close(Client);
+}
+
+/// create a Unix socket listening at @p Path
+///
+/// @returns the socket, or -1 on errors
+int listenAt(const std::string &Path) {
+  sockaddr_un Address{};
+  Address.sun_family = AF_UNIX;
+  if (Path.size() >= sizeof(Address.sun_path)) {
+    llvm::errs() << "SOCKET PATH TOO LONG " << Path << "\n";
+    return -1;
+  }
+  std::memcpy(Address.sun_path, Path.c_str(), Path.size() + 1);
+
+  // remove the socket of an earlier server, but nothing else
+  llvm::sys::fs::file_status Status;
+  if (not llvm::sys::fs::status(Path, Status) and
+      Status.type() == llvm::sys::fs::file_type::socket_file)
+    unlink(Path.c_str());
+
+  const auto Socket = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (Socket < 0 or
+      bind(Socket, reinterpret_cast<const sockaddr *>(&Address),
+           sizeof(Address)) != 0 or
+      listen(Socket, SOMAXCONN) != 0) {
+    llvm::errs() << "COULD NOT LISTEN AT " << Path << ": "
+                 << std::strerror(errno) << "\n";
+    if (Socket >= 0)
+      close(Socket);
+    return -1;
+  }
+
+  return Socket;
+}
+} // namespace
+
+bool serve(const std::string &SocketPath, const DB &Db,
+           const ReportKind &Defaults, const UpdateFunction &Update) {
+  // clients may hang up before reading their report
+  std::signal(SIGPIPE, SIG_IGN);
+
+  Watcher Files;
+  if (Files.fd() < 0) {
+    llvm::errs() << "COULD NOT WATCH FILES: " << std::strerror(errno) << "\n";
+    return false;
+  }
+
+  const auto Socket = listenAt(SocketPath);
+  if (Socket < 0)
+    return false;
+
+  Update({});
+  Files.watchDependencies(Db);
+
+  llvm::StringSet<> Changed;
+  const auto UpdateChanged = [&]() {
+    std::vector<std::string> Paths;
+    Paths.reserve(Changed.size());
+    for (const auto &Path : Changed)
+      Paths.push_back(Path.getKey().str());
+    Changed.clear();
+
+    Update(Paths);
+    Files.watchDependencies(Db);
+  };
+
+  while (true) {
+    pollfd Fds[] = {{Socket, POLLIN, 0}, {Files.fd(), POLLIN, 0}};
+
+    // once something changed, wait only until changes settle
+    const auto Ready = poll(Fds, 2, Changed.empty() ? -1 : SettleMilliseconds);
+    if (Ready < 0) {
+      if (errno == EINTR)
+        continue;
+      llvm::errs() << "COULD NOT POLL: " << std::strerror(errno) << "\n";
+      close(Socket);
+      return false;
+    }
+
+    if (Ready == 0) {
+      UpdateChanged();
+      continue;
+    }
+
+    if (Fds[1].revents & POLLIN)
+      Files.readChanges(Changed);
+
+    if (Fds[0].revents & POLLIN) {
+      const auto Client = accept4(Socket, nullptr, nullptr, SOCK_CLOEXEC);
+      if (Client < 0)
+        continue;
+
+      // answer with the state of the files as of the request
+      if (not Changed.empty())
+        UpdateChanged();
+      answer(Client, Db, Defaults);
+    }
+  }
+}
@@ -0,0 +1,35 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "Report.h"
+
+class DB;
+
+/// bring the database up to date after the files at the given paths changed
+///
+/// Called without paths for the initial extraction.
+using UpdateFunction =
+    std::function<void(const std::vector<std::string> &Changed)>;
+
+/// keep @p Db current and answer report requests until killed
+///
+/// The directories of all files read by the translation units recorded in
+/// @p Db are watched; once changes to these files settle, @p Update is called
+/// with the changed files. Requests arriving meanwhile are answered after the
+/// update.
+///
+/// Clients connect to the Unix socket at @p SocketPath and send one line of
+/// space-separated settings overriding @p Defaults: `owns=0|1`, `uses=0|1`,
+/// `binds=0|1`, `methods=0|1`, `depth=N`, `format=plantuml|dot|json|graphml`
+/// and any number of `class=Name`. The report is sent back and the
+/// connection closed.
+///
+/// @returns false if the socket or the file watches could not be set up
+bool serve(const std::string &SocketPath, const DB &Db,
+           const ReportKind &Defaults, const UpdateFunction &Update);
+
+#endif // SERVER_H
@@ -0,0 +1,176 @@
+#include "Stats.h"
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <system_error>
+
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/TimeProfiler.h"
+#include "llvm/Support/raw_ostream.h"
+
+namespace {
+constexpr size_t NumCounters = static_cast<size_t>(Counter::Queries) + 1;
+constexpr size_t NumPhases = static_cast<size_t>(Phase::Report) + 1;
+
+std::atomic<bool> StatsEnabled{false};
+bool TraceEnabled = false;
+unsigned TraceGranularity = 0;
+
+std::array<std::atomic<uint64_t>, NumCounters> Counters{};
+std::array<std::atomic<uint64_t>, NumPhases> PhaseCalls{};
+std::array<std::atomic<uint64_t>, NumPhases> PhaseNanoseconds{};
+
+const char *counterName(Counter C) {
+  switch (C) {
+  case Counter::TranslationUnits:
+    return "translation units parsed";
+  case Counter::Matches:
+    return "classes matched";
+  case Counter::ClassesRecorded:
+    return "classes recorded";
+  case Counter::RowsInserted:
+    return "rows inserted";
+  case Counter::RowsIgnored:
+    return "rows ignored as duplicates";
+  case Counter::Queries:
+    return "queries run";
+  }
+  return "";
+}
+
+const char *phaseName(Phase P) {
+  switch (P) {
+  case Phase::SelectSources:
+    return "select changed sources";
+  case Phase::Prefilter:
+    return "prefilter";
+  case Phase::WaitForMemory:
+    return "wait for memory budget";
+  case Phase::TranslationUnit:
+    return "translation unit";
+  case Phase::Match:
+    return "match";
+  case Phase::Record:
+    return "record";
+  case Phase::Write:
+    return "write";
+  case Phase::Report:
+    return "report";
+  }
+  return "";
+}
+
+uint64_t get(const std::array<std::atomic<uint64_t>, NumPhases> &Values,
+             Phase P) {
+  return Values[static_cast<size_t>(P)].load(std::memory_order_relaxed);
+}
+
+void printPhase(llvm::raw_ostream &OS, llvm::StringRef Name, unsigned Indent,
+                uint64_t Calls, uint64_t Nanoseconds) {
+  OS.indent(Indent) << llvm::left_justify(Name, 28 - Indent)
+     << llvm::format("%10llu %12.3f\n", static_cast<unsigned long long>(Calls),
+                     Nanoseconds / 1e9);
+}
+} // namespace
+
+void enableStats() { StatsEnabled = true; }
+
+void enableTrace(unsigned Granularity) {
+  TraceEnabled = true;
+  TraceGranularity = Granularity;
+  llvm::timeTraceProfilerInitialize(Granularity, "umler");
+}
+
+void count(Counter C, uint64_t N) {
+  if (StatsEnabled.load(std::memory_order_relaxed))
+    Counters[static_cast<size_t>(C)].fetch_add(N, std::memory_order_relaxed);
+}
+
+PhaseTimer::PhaseTimer(Phase P, llvm::StringRef Detail)
+    : P(P), Start(std::chrono::steady_clock::now()),
+      Traced(llvm::timeTraceProfilerEnabled()) {
+  if (Traced)
+    llvm::timeTraceProfilerBegin(phaseName(P), Detail);
+}
+
+PhaseTimer::~PhaseTimer() {
+  if (Traced)
+    llvm::timeTraceProfilerEnd();
+
+  if (not StatsEnabled.load(std::memory_order_relaxed))
+    return;
+
+  const auto Elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now() - Start);
+  const auto Index = static_cast<size_t>(P);
+  PhaseCalls[Index].fetch_add(1, std::memory_order_relaxed);
+  PhaseNanoseconds[Index].fetch_add(Elapsed.count(),
+                                    std::memory_order_relaxed);
+}
+
+ThreadTrace::ThreadTrace() {
+  // a worker run on the main thread shares its profiler
+  if (TraceEnabled and not llvm::timeTraceProfilerEnabled()) {
+    llvm::timeTraceProfilerInitialize(TraceGranularity, "umler");
+    Owned = true;
+  }
+}
+
+ThreadTrace::~ThreadTrace() {
+  if (Owned)
+    llvm::timeTraceProfilerFinishThread();
+}
+
+void printStats(llvm::raw_ostream &OS) {
+  if (not StatsEnabled)
+    return;
+
+  OS << "===-- umler statistics --===\n";
+  OS << llvm::left_justify("phase", 28) << llvm::right_justify("count", 10)
+     << llvm::right_justify("time (s)", 13) << "\n";
+
+  const auto Print = [&OS](Phase P, unsigned Indent) {
+    printPhase(OS, phaseName(P), Indent, get(PhaseCalls, P),
+               get(PhaseNanoseconds, P));
+  };
+
+  Print(Phase::SelectSources, 0);
+  Print(Phase::Prefilter, 0);
+  Print(Phase::WaitForMemory, 0);
+  Print(Phase::TranslationUnit, 0);
+  // parsing is everything in a translation unit which is not matching
+  const auto Units = get(PhaseNanoseconds, Phase::TranslationUnit);
+  const auto Matching = get(PhaseNanoseconds, Phase::Match);
+  printPhase(OS, "parse", 2, get(PhaseCalls, Phase::TranslationUnit),
+             Units > Matching ? Units - Matching : 0);
+  Print(Phase::Match, 2);
+  Print(Phase::Record, 4);
+  Print(Phase::Write, 0);
+  Print(Phase::Report, 0);
+
+  OS << "\ncounter\n";
+  for (size_t I = 0; I < NumCounters; ++I)
+    OS << llvm::left_justify(counterName(static_cast<Counter>(I)), 28)
+       << llvm::format("%10llu\n", static_cast<unsigned long long>(
+                                       Counters[I].load()));
+}
+
+bool writeTrace(llvm::StringRef Path) {
+  if (not TraceEnabled)
+    return true;
+
+  std::error_code EC;
+  llvm::raw_fd_ostream OS(Path, EC, llvm::sys::fs::OF_Text);
+  if (EC) {
+    llvm::errs() << "COULD NOT WRITE TRACE " << Path << ": " << EC.message()
+                 << "\n";
+    return false;
+  }
+
+  llvm::timeTraceProfilerWrite(OS);
+  llvm::timeTraceProfilerCleanup();
+  TraceEnabled = false;
+  return true;
+}
@@ -0,0 +1,86 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <chrono>
+#include <cstdint>
+
+#include "llvm/ADT/StringRef.h"
+
+namespace llvm {
+class raw_ostream;
+} // namespace llvm
+
+/// events counted with `-stats`
+enum class Counter {
+  TranslationUnits,
+  Matches,
+  ClassesRecorded,
+  RowsInserted,
+  RowsIgnored,
+  Queries,
+};
+
+/// phases timed with `-stats`, summed over all threads
+enum class Phase {
+  SelectSources,
+  Prefilter,
+  WaitForMemory,
+  TranslationUnit,
+  Match,
+  Record,
+  Write,
+  Report,
+};
+
+/// start collecting counters and phase timings
+void enableStats();
+
+/// start collecting Chrome trace events, see `writeTrace`
+///
+/// @param Granularity minimum duration of recorded events in microseconds
+void enableTrace(unsigned Granularity);
+
+/// count @p N occurrences of @p C if stats are enabled
+void count(Counter C, uint64_t N = 1);
+
+/// time a phase for the summary and as a trace event
+///
+/// Phases may nest, but must end on the thread they started on.
+class PhaseTimer {
+public:
+  /// @param Detail shown with the trace event, e.g. the file worked on
+  explicit PhaseTimer(Phase P, llvm::StringRef Detail = "");
+  ~PhaseTimer();
+
+  PhaseTimer(const PhaseTimer &) = delete;
+  PhaseTimer &operator=(const PhaseTimer &) = delete;
+
+private:
+  const Phase P;
+  const std::chrono::steady_clock::time_point Start;
+  const bool Traced;
+};
+
+/// collect trace events of a thread other than the main one while in scope
+class ThreadTrace {
+public:
+  ThreadTrace();
+  ~ThreadTrace();
+
+  ThreadTrace(const ThreadTrace &) = delete;
+  ThreadTrace &operator=(const ThreadTrace &) = delete;
+
+private:
+  bool Owned = false;
+};
+
+/// print a summary of all counters and phases if stats are enabled
+void printStats(llvm::raw_ostream &OS);
+
+/// write the trace events of all threads to @p Path in Chrome's trace event
+/// format if tracing is enabled
+///
+/// All threads with a `ThreadTrace` must have finished.
+bool writeTrace(llvm::StringRef Path);
+
+#endif // STATS_H
@@ -0,0 +1,134 @@
+#ifndef STORAGE_H
+#define STORAGE_H
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "llvm/ADT/StringRef.h"
+
+struct ReportKind;
+struct TranslationUnitCost;
+
+/// receives the rows of a report as they are read from storage
+///
+/// Strings passed to a call stay valid until the next call, except for the
+/// name of a class, which stays valid while its relations are visited.
+class ReportVisitor {
+public:
+  virtual ~ReportVisitor() = default;
+
+  /// a class, followed by its relations
+  ///
+  /// @param Instances the number of instantiations counted if the class is a
+  /// template whose instantiations were not all recorded as classes, else 0
+  virtual void visitClass(llvm::StringRef Name, llvm::StringRef Ns,
+                          int64_t Instances) {}
+
+  /// relations of the class visited last
+  /// @{
+  virtual void visitMethod(llvm::StringRef Name, llvm::StringRef Returns,
+                           llvm::StringRef Parameters, int Access,
+                           bool IsStatic, bool IsAbstract) {}
+  virtual void visitOwns(llvm::StringRef Object, llvm::StringRef Name) {}
+  virtual void visitUses(llvm::StringRef Object) {}
+  /// @}
+
+  virtual void visitTemplateInstance(llvm::StringRef Instance,
+                                     llvm::StringRef Tmpl,
+                                     llvm::StringRef TemplateArgs) {}
+  virtual void visitInheritance(llvm::StringRef Derived,
+                                llvm::StringRef Base) {}
+};
+
+/// where extracted classes and their relations are recorded and reports are
+/// read from
+///
+/// Names of classes and types are unqualified; relations refer to classes by
+/// name. Inserting a row which is already present is not an error and keeps
+/// the existing one.
+class Storage {
+public:
+  virtual ~Storage() = default;
+
+  /// open a transaction for a bulk load
+  virtual bool begin() const = 0;
+
+  /// commit the transaction opened with `begin`
+  virtual bool commit() const = 0;
+
+  /// typed inserts; duplicates are ignored
+  ///
+  /// @param File the file defining the class a row belongs to, or for
+  /// instantiations the file instantiating it, empty if not tracked; rows are
+  /// removed together with the records from this file
+  /// @{
+  virtual bool insertClass(llvm::StringRef Name, llvm::StringRef Ns,
+                           llvm::StringRef File) const = 0;
+  virtual bool insertTemplateInstance(llvm::StringRef Instance,
+                                      llvm::StringRef Tmpl,
+                                      llvm::StringRef TemplateArgs,
+                                      llvm::StringRef File) const = 0;
+  virtual bool insertMethod(llvm::StringRef Cls, llvm::StringRef Name,
+                            llvm::StringRef Returns,
+                            llvm::StringRef Parameters, int Access,
+                            bool IsStatic, bool IsAbstract,
+                            llvm::StringRef File) const = 0;
+  virtual bool insertOwns(llvm::StringRef Owner, llvm::StringRef Object,
+                          llvm::StringRef Name,
+                          llvm::StringRef File) const = 0;
+  virtual bool insertUses(llvm::StringRef User, llvm::StringRef Object,
+                          llvm::StringRef File) const = 0;
+  virtual bool insertInheritance(llvm::StringRef Derived,
+                                 llvm::StringRef Base,
+                                 llvm::StringRef File) const = 0;
+  /// @}
+
+  /// record a distinct instantiation of the template @p Tmpl in namespace
+  /// @p Ns, told apart from others by the hash @p Hash of its name
+  ///
+  /// Templates with an instantiation recorded as their template are reported
+  /// with the number of distinct instantiations recorded for them, so counts
+  /// from several runs or merged databases are their union. Instantiations
+  /// are not attributed to files and so never removed with their records;
+  /// after incremental runs counts include those no longer in the code.
+  ///
+  /// @param Collapsed whether the instantiation was recorded as its template
+  virtual bool insertCountedInstance(llvm::StringRef Tmpl, llvm::StringRef Ns,
+                                     int64_t Hash, bool Collapsed) const = 0;
+
+  /// record that the translation unit at @p Path was parsed
+  ///
+  /// @param CommandHash hash of the compile command and extraction settings
+  /// @param Dependencies all files read with a hash of their contents
+  /// @param Cost the memory and time the parse took
+  virtual bool insertTranslationUnit(
+      llvm::StringRef Path, int64_t CommandHash,
+      const std::vector<std::pair<std::string, int64_t>> &Dependencies,
+      const TranslationUnitCost &Cost) const = 0;
+
+  /// select the rows to report for @p Kind, e.g. the neighbourhood of the
+  /// requested classes for scoped reports
+  ///
+  /// Must precede the `visit` calls of every report, which stream the
+  /// selected rows one at a time, so that reports need not hold them all.
+  virtual bool selectReport(const ReportKind &Kind) const = 0;
+
+  /// stream the selected classes ordered by namespace and name, each
+  /// followed by its methods, owns and uses relations as enabled in @p Kind,
+  /// in that order and in the order they were recorded
+  virtual bool visitClasses(const ReportKind &Kind,
+                            ReportVisitor &Visitor) const = 0;
+
+  /// stream the selected template instances ordered by template and
+  /// template arguments
+  virtual bool visitTemplateInstances(const ReportKind &Kind,
+                                      ReportVisitor &Visitor) const = 0;
+
+  /// stream the selected inheritance edges in the order they were recorded
+  virtual bool visitInheritance(const ReportKind &Kind,
+                                ReportVisitor &Visitor) const = 0;
+};
+
+#endif // STORAGE_H
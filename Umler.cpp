@@ -1,10 +1,23 @@
 #include <algorithm>
+#include <array>
+#include <atomic>
 #include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
 #include <functional>
 #include <iterator>
 #include <memory>
+#include <mutex>
+#include <optional>
 #include <string>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include <vector>
 
+#include "clang/AST/ASTConsumer.h"
+#include "clang/AST/ASTContext.h"
 #include "clang/AST/Decl.h"
 #include "clang/AST/DeclBase.h"
 #include "clang/AST/DeclCXX.h"
@@ -14,23 +27,56 @@
 #include "clang/ASTMatchers/ASTMatchFinder.h"
 #include "clang/ASTMatchers/ASTMatchers.h"
 #include "clang/ASTMatchers/ASTMatchersInternal.h"
+#include "clang/Basic/Diagnostic.h"
+#include "clang/Basic/FileManager.h"
 #include "clang/Basic/LLVM.h"
+#include "clang/Basic/SourceManager.h"
+#include "clang/Frontend/CompilerInstance.h"
+#include "clang/Frontend/CompilerInvocation.h"
+#include "clang/Frontend/FrontendAction.h"
+#include "clang/Frontend/MultiplexConsumer.h"
+#include "clang/Index/USRGeneration.h"
+#include "clang/Lex/Preprocessor.h"
 #include "clang/Tooling/ArgumentsAdjusters.h"
 #include "clang/Tooling/CommonOptionsParser.h"
-#include "clang/Tooling/Refactoring.h"
 #include "clang/Tooling/Tooling.h"
 #include "llvm/ADT/APSInt.h"
 #include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/STLExtras.h"
 #include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/ADT/StringMap.h"
 #include "llvm/ADT/StringRef.h"
+#include "llvm/ADT/StringSet.h"
+#include "llvm/ADT/Twine.h"
+#include "llvm/Support/Allocator.h"
 #include "llvm/Support/Casting.h"
 #include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Error.h"
 #include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
 #include "llvm/Support/Signals.h"
+#include "llvm/Support/StringSaver.h"
+#include "llvm/Support/VirtualFileSystem.h"
+#include "llvm/Support/xxhash.h"
 #include "llvm/Support/raw_ostream.h"
 
+#include "ClassGraph.h"
 #include "DB.h"
+#include "Diff.h"
+#include "Incremental.h"
+#include "Precompiled.h"
+#include "Prefilter.h"
+#include "RecordWriter.h"
+#include "Records.h"
 #include "Report.h"
+#include "Server.h"
+#include "Stats.h"
 
 using namespace clang;
 using namespace clang::ast_matchers;
@@ -46,6 +92,46 @@ static cl::list<std::string> ClassName("c", cl::desc("Class Name"),
 static cl::opt<std::string> DBPath("d", cl::desc("path to result database"),
                                    cl::init(":memory:"),
                                    cl::cat(UmlerCategory));
+static cl::opt<int> ReportDepth(
+    "report-depth",
+    cl::desc("with -c, only report classes related to the requested ones by "
+             "at most this many relations (default: report all classes)"),
+    cl::init(-1), cl::cat(UmlerCategory));
+static cl::opt<ReportType> Format(
+    "format", cl::desc("format of the report"),
+    cl::values(clEnumValN(ReportType::plantuml, "plantuml",
+                          "PlantUML class diagram (default)"),
+               clEnumValN(ReportType::dot, "dot", "Graphviz graph"),
+               clEnumValN(ReportType::json, "json",
+                          "JSON object of classes and relations"),
+               clEnumValN(ReportType::graphml, "graphml", "GraphML graph")),
+    cl::init(ReportType::plantuml), cl::cat(UmlerCategory));
+static cl::opt<std::string>
+    OutputPath("o", cl::desc("write the report to this file"),
+               cl::value_desc("file"), cl::init("-"), cl::cat(UmlerCategory));
+static cl::opt<std::string>
+    DiffDB("diff",
+           cl::desc("instead of a report, list the classes and relations "
+                    "added to the result database since this one"),
+           cl::value_desc("db"), cl::cat(UmlerCategory));
+static cl::opt<bool> DiffDiagram(
+    "diff-diagram",
+    cl::desc("with -diff, draw the changes as a plantuml or dot diagram"),
+    cl::init(false), cl::cat(UmlerCategory));
+static cl::opt<std::string>
+    DBJournalMode("db-journal-mode",
+                  cl::desc("sqlite journal mode of the result database, "
+                           "e.g. `wal`"),
+                  cl::cat(UmlerCategory));
+static cl::opt<std::string>
+    DBSynchronous("db-synchronous",
+                  cl::desc("sqlite synchronous setting of the result "
+                           "database, e.g. `off` for bulk loads"),
+                  cl::cat(UmlerCategory));
+static cl::opt<unsigned>
+    DBBatchSize("db-batch-size",
+                cl::desc("number of inserted rows per transaction"),
+                cl::init(10000), cl::cat(UmlerCategory));
 static cl::opt<bool> DocumentUses("document-uses",
                                   cl::desc("show uses relationships"),
                                   cl::init(false), cl::cat(UmlerCategory));
@@ -58,57 +144,492 @@ static cl::opt<bool> DocumentBinds("document-binds",
 static cl::opt<bool> DocumentMethods("document-methods",
                                      cl::desc("show class methods"),
                                      cl::init(true), cl::cat(UmlerCategory));
+static cl::opt<bool>
+    Incremental("incremental",
+                cl::desc("skip translation units unchanged since they were "
+                         "last recorded in the result database"),
+                cl::init(true), cl::cat(UmlerCategory));
+static cl::opt<bool> SkipFunctionBodies(
+    "skip-function-bodies",
+    cl::desc("do not parse function bodies; faster, but misses classes only "
+             "defined or instantiated inside function bodies"),
+    cl::init(false), cl::cat(UmlerCategory));
+static cl::opt<bool> MainFileOnly(
+    "main-file-only",
+    cl::desc("only extract classes declared in the sources themselves, not "
+             "in headers"),
+    cl::init(false), cl::cat(UmlerCategory));
+static cl::opt<bool> SkipSystemHeaders(
+    "skip-system-headers",
+    cl::desc("do not extract classes declared in system headers"),
+    cl::init(false), cl::cat(UmlerCategory));
+static cl::list<std::string> IncludeRoots(
+    "include-root",
+    cl::desc("only extract classes declared in files below these "
+             "directories"),
+    cl::value_desc("dir"), cl::CommaSeparated, cl::cat(UmlerCategory));
+static cl::list<std::string> ExcludeRoots(
+    "exclude-root",
+    cl::desc("do not extract classes declared in files below these "
+             "directories"),
+    cl::value_desc("dir"), cl::CommaSeparated, cl::cat(UmlerCategory));
+/// how instantiations of class templates are recorded
+enum class InstanceMode { All, Collapse, Cap };
+static cl::opt<InstanceMode> TemplateInstances(
+    "template-instances",
+    cl::desc("how to record instantiations of class templates"),
+    cl::values(
+        clEnumValN(InstanceMode::All, "all",
+                   "each as a class of its own (default)"),
+        clEnumValN(InstanceMode::Collapse, "collapse",
+                   "as their template, counting them"),
+        clEnumValN(InstanceMode::Cap, "cap",
+                   "the first -template-instance-cap ones of each template "
+                   "as classes, further ones as their template, counting "
+                   "them")),
+    cl::init(InstanceMode::All), cl::cat(UmlerCategory));
+static cl::opt<unsigned> TemplateInstanceCap(
+    "template-instance-cap",
+    cl::desc("with -template-instances=cap, the number of instantiations "
+             "recorded as classes per template"),
+    cl::init(16), cl::cat(UmlerCategory));
+static cl::opt<unsigned> TemplateArgsMaxLength(
+    "template-args-max-length",
+    cl::desc("shorten template argument lists in class names longer than "
+             "this to a prefix and a hash of the full list (0: never)"),
+    cl::init(0), cl::cat(UmlerCategory));
+static cl::opt<bool> PrefilterSources(
+    "prefilter",
+    cl::desc("with -c, only parse sources which textually mention a requested "
+             "class in themselves or their includes"),
+    cl::init(false), cl::cat(UmlerCategory));
+static cl::opt<unsigned>
+    Jobs("j",
+         cl::desc("number of translation units to parse in parallel "
+                  "(0: one per hardware thread)"),
+         cl::init(1), cl::cat(UmlerCategory));
+static cl::opt<std::string>
+    Shard("shard",
+          cl::desc("only parse the sources of shard `i/N`, selected by a hash "
+                   "of their path as given"),
+          cl::value_desc("i/N"), cl::cat(UmlerCategory));
+static cl::list<std::string>
+    MergeDBs("merge",
+             cl::desc("merge these databases, e.g. of all shards, into the "
+                      "result database before parsing"),
+             cl::value_desc("db"), cl::CommaSeparated, cl::cat(UmlerCategory));
+static cl::opt<unsigned> MemoryBudget(
+    "memory-budget",
+    cl::desc("with -j, only start a translation unit while the memory the "
+             "ones being parsed took in earlier runs fits into this budget "
+             "(0: no limit)"),
+    cl::value_desc("MiB"), cl::init(0), cl::cat(UmlerCategory));
+static cl::opt<std::string> ServeSocket(
+    "serve",
+    cl::desc("keep running, re-extracting sources as files they read change, "
+             "and answer report requests on this Unix socket"),
+    cl::value_desc("socket"), cl::cat(UmlerCategory));
+static cl::opt<std::string> PchCache(
+    "pch-cache",
+    cl::desc("precompile the leading includes shared by sources into this "
+             "directory and reuse them across sources and runs"),
+    cl::value_desc("directory"), cl::cat(UmlerCategory));
+static cl::opt<unsigned> PchMinSources(
+    "pch-min-sources",
+    cl::desc("number of sources which must share leading includes for them "
+             "to be precompiled"),
+    cl::init(2), cl::cat(UmlerCategory));
+static cl::opt<bool>
+    PrintStats("stats",
+               cl::desc("print time spent per phase and event counts"),
+               cl::init(false), cl::cat(UmlerCategory));
+static cl::opt<std::string> StatsTrace(
+    "stats-trace",
+    cl::desc("write a Chrome trace event file of all phases to this path"),
+    cl::cat(UmlerCategory));
+static cl::opt<unsigned> StatsTraceGranularity(
+    "stats-trace-granularity",
+    cl::desc("minimum duration of trace events in microseconds"),
+    cl::init(500), cl::cat(UmlerCategory));
 
-struct BaseCallbackData {
-  const CXXRecordDecl *Derived;
-  const DB *Db;
+/// size of the buffer reports are written through
+constexpr size_t ReportBufferSize = 1 << 20;
+
+/// whether the origin of records is tracked for incremental runs
+bool trackFiles() {
+  return Incremental and (DBPath != ":memory:" or not ServeSocket.empty());
+}
+
+/// make a directory given to `-include-root` or `-exclude-root` absolute and
+/// canonical, relative to the current directory
+std::string normalizedRoot(StringRef Root) {
+  SmallString<256> Path(Root);
+  sys::fs::make_absolute(Path);
+  sys::path::remove_dots(Path, /*remove_dot_dot=*/true);
+  while (Path.size() > 1 and sys::path::is_separator(Path.back()))
+    Path.pop_back();
+  return std::string(Path.str());
+}
+
+/// a description of all options which affect the records extracted
+std::string extractionSettings() {
+  std::string Settings = SkipFunctionBodies ? "skip-function-bodies\n" : "";
+  for (const auto &Name : ClassName) {
+    Settings += Name;
+    Settings += '\n';
+  }
+  if (MainFileOnly)
+    Settings += "main-file-only\n";
+  if (SkipSystemHeaders)
+    Settings += "skip-system-headers\n";
+  // relative roots select different files from different directories
+  for (const auto &Root : IncludeRoots)
+    Settings += "include-root " + normalizedRoot(Root) + '\n';
+  for (const auto &Root : ExcludeRoots)
+    Settings += "exclude-root " + normalizedRoot(Root) + '\n';
+  if (TemplateInstances == InstanceMode::Collapse)
+    Settings += "template-instances collapse\n";
+  if (TemplateInstances == InstanceMode::Cap)
+    Settings += "template-instances cap " +
+                std::to_string(TemplateInstanceCap) + '\n';
+  if (TemplateArgsMaxLength > 0)
+    Settings += "template-args-max-length " +
+                std::to_string(TemplateArgsMaxLength) + '\n';
+  return Settings;
+}
+
+/// make a file name as seen by the frontend absolute and canonical
+std::string absolutePath(const FileManager &Files, StringRef Name) {
+  SmallString<256> Path(Name);
+  Files.makeAbsolutePath(Path);
+  sys::path::remove_dots(Path, /*remove_dot_dot=*/true);
+  return std::string(Path.str());
+}
+
+/// decides which files classes are extracted from
+///
+/// Set up from `-main-file-only`, `-skip-system-headers`, `-include-root` and
+/// `-exclude-root`; relative roots are taken relative to the current
+/// directory.
+class FileFilter {
+public:
+  FileFilter() {
+    for (const auto &Root : IncludeRoots)
+      Included.push_back(normalizedRoot(Root));
+    for (const auto &Root : ExcludeRoots)
+      Excluded.push_back(normalizedRoot(Root));
+  }
+
+  /// whether classes from all files are extracted
+  bool acceptsAll() const {
+    return not MainFileOnly and not SkipSystemHeaders and Included.empty() and
+           Excluded.empty();
+  }
+
+  /// whether classes declared in @p File are extracted
+  bool accepts(const SourceManager &SM, FileID File) const {
+    if (File.isInvalid())
+      return false;
+    if (MainFileOnly and File != SM.getMainFileID())
+      return false;
+    if (SkipSystemHeaders and
+        SM.isInSystemHeader(SM.getLocForStartOfFile(File)))
+      return false;
+    if (Included.empty() and Excluded.empty())
+      return true;
+
+    const auto *const Entry = SM.getFileEntryForID(File);
+    if (not Entry)
+      return false;
+
+    const auto Path = absolutePath(SM.getFileManager(), Entry->getName());
+    return (Included.empty() or below(Path, Included)) and
+           not below(Path, Excluded);
+  }
+
+private:
+  static bool below(StringRef Path, const std::vector<std::string> &Roots) {
+    return llvm::any_of(Roots, [Path](StringRef Root) {
+      return Path.startswith(Root) and
+             (Path.size() == Root.size() or
+              sys::path::is_separator(Root.back()) or
+              sys::path::is_separator(Path[Root.size()]));
+    });
+  }
+
+  std::vector<std::string> Included;
+  std::vector<std::string> Excluded;
 };
 
-/// obtain name from some class-like entity
+/// where @p Cl was instantiated, if it is an instantiation of a class
+/// template or of a member class of one
+SourceLocation pointOfInstantiation(const CXXRecordDecl &Cl) {
+  if (const auto *const Inst = dyn_cast<ClassTemplateSpecializationDecl>(&Cl))
+    return isTemplateInstantiation(Inst->getSpecializationKind())
+               ? Inst->getPointOfInstantiation()
+               : SourceLocation{};
+  if (const auto *const Member = Cl.getMemberSpecializationInfo())
+    if (isTemplateInstantiation(Member->getTemplateSpecializationKind()))
+      return Member->getPointOfInstantiation();
+  return {};
+}
+
+/// the file @p Cl is recorded from, if files are tracked
 ///
-/// declared as a template to inhibit conversion
-/// @param v the class-like entity to work on
-template <typename T> std::string className(const T &V);
-template <> std::string className<CXXRecordDecl>(const CXXRecordDecl &);
-template <> std::string className<QualType>(const QualType &);
-template <> std::string className<TemplateArgument>(const TemplateArgument &);
-
-template <> std::string className<CXXRecordDecl>(const CXXRecordDecl &Cl) {
-  if (const auto *const T =
-          dyn_cast_or_null<ClassTemplateSpecializationDecl>(&Cl)) {
-    std::string Name = Cl.getNameAsString();
-    Name += "<";
-    const auto &Args = T->getTemplateArgs();
-
-    for (unsigned I = 0; I < Args.size(); ++I) {
-      if (I > 0)
-        Name += ", ";
-      Name += className(Args.get(I));
+/// This is the file containing its definition, or for instantiations the one
+/// instantiating it: the template's file does not change when the code using
+/// an instantiation does, so its records would never be replaced.
+std::string definitionFile(const CXXRecordDecl *Cl) {
+  if (not trackFiles())
+    return {};
+
+  const auto &SM = Cl->getASTContext().getSourceManager();
+  auto Loc = pointOfInstantiation(*Cl);
+  if (Loc.isInvalid())
+    Loc = Cl->getLocation();
+  Loc = SM.getExpansionLoc(Loc);
+  if (const auto *const Entry = SM.getFileEntryForID(SM.getFileID(Loc)))
+    return absolutePath(SM.getFileManager(), Entry->getName());
+  return {};
+}
+
+/// classes already recorded by any worker, identified by their USR
+///
+/// Headers are parsed again by every translation unit including them; this
+/// lets all but the first match of a class skip walking it. Instantiations
+/// are told apart by the file instantiating them as well, so that they are
+/// recorded from every such file. Safe to use from multiple threads.
+class RecordedClasses {
+public:
+  /// mark @p Cl as recorded
+  ///
+  /// @returns false if it was recorded before
+  bool insert(const CXXRecordDecl &Cl) {
+    SmallString<128> USR;
+    if (index::generateUSRForDecl(&Cl, USR))
+      return true; // cannot identify it across translation units
+    if (pointOfInstantiation(Cl).isValid()) {
+      USR += '\0';
+      USR += definitionFile(&Cl);
+    }
+
+    auto &Bucket = Shards[xxHash64(USR) % NumShards];
+    std::lock_guard<std::mutex> Lock(Bucket.Mutex);
+    return Bucket.USRs.insert(USR).second;
+  }
+
+private:
+  static constexpr size_t NumShards = 64;
+
+  struct Shard {
+    std::mutex Mutex;
+    StringSet<> USRs;
+  };
+
+  std::array<Shard, NumShards> Shards;
+};
+
+/// the namespace @p Cl is recorded in
+std::string enclosingNamespace(const CXXRecordDecl *Cl) {
+  std::string NsName = "";
+  const auto *Context = Cl->getEnclosingNamespaceContext();
+  while (not Context->isFileContext()) {
+    if (const auto *const Ns = dyn_cast<NamespaceDecl>(Context)) {
+      const auto Name = Ns->getNameAsString();
+      NsName = Name + "::";
+      Context = Context->getEnclosingNamespaceContext();
+    } else {
+      break;
     }
-    Name += ">";
+  }
+  return NsName.substr(0, NsName.size() - 2);
+}
+
+/// decides which instantiations of class templates are recorded as classes
+/// of their own, over all worker threads
+///
+/// The others are recorded as their template. Templates are told apart by
+/// their qualified name and instantiations by a hash of their name; all
+/// distinct instantiations seen are recorded, so that reports can tell how
+/// many there were over all runs and merged databases.
+class TemplateInstanceFilter {
+public:
+  TemplateInstanceFilter(InstanceMode Mode, unsigned Cap)
+      : Mode(Mode), Cap(Cap) {}
 
+  /// whether the instantiation named @p Instance of @p Template is recorded
+  /// as a class of its own
+  ///
+  /// Stable for an instantiation once decided.
+  bool keep(const ClassTemplateDecl *Template, StringRef Instance) {
+    if (Mode == InstanceMode::All)
+      return true;
+
+    const auto Key = Template->getQualifiedNameAsString();
+    const auto Hash = xxHash64(Instance);
+    auto &Bucket = Shards[xxHash64(Key) % NumShards];
+    std::lock_guard<std::mutex> Lock(Bucket.Mutex);
+    const auto Inserted = Bucket.Templates.try_emplace(Key);
+    auto &Seen = Inserted.first->second;
+    if (Inserted.second) {
+      Seen.Name = Template->getNameAsString();
+      Seen.Namespace = enclosingNamespace(Template->getTemplatedDecl());
+    }
+
+    if (Seen.Kept.count(Hash))
+      return true;
+    if (Mode == InstanceMode::Cap and Seen.Kept.size() < Cap) {
+      Seen.Kept.insert(Hash);
+      return true;
+    }
+    Seen.Collapsed.insert(Hash);
+    return false;
+  }
+
+  /// the distinct instantiations seen of all templates
+  std::vector<CountedInstancesRecord> counted() {
+    std::vector<CountedInstancesRecord> Counted;
+    for (auto &Bucket : Shards) {
+      std::lock_guard<std::mutex> Lock(Bucket.Mutex);
+      for (const auto &Entry : Bucket.Templates) {
+        const auto &Seen = Entry.second;
+        auto Record = CountedInstancesRecord{Seen.Name, Seen.Namespace, {}};
+        for (const auto Hash : Seen.Kept)
+          Record.Instances.emplace_back(static_cast<int64_t>(Hash), false);
+        for (const auto Hash : Seen.Collapsed)
+          Record.Instances.emplace_back(static_cast<int64_t>(Hash), true);
+        Counted.push_back(std::move(Record));
+      }
+    }
+    return Counted;
+  }
+
+private:
+  static constexpr size_t NumShards = 64;
+
+  struct Instances {
+    std::string Name;
+    std::string Namespace;
+    DenseSet<uint64_t> Kept;
+    DenseSet<uint64_t> Collapsed;
+  };
+
+  struct Shard {
+    std::mutex Mutex;
+    StringMap<Instances> Templates;
+  };
+
+  const InstanceMode Mode;
+  const unsigned Cap;
+  std::array<Shard, NumShards> Shards;
+};
+
+/// display names of classes and types, memoized per translation unit
+///
+/// Names are keyed on canonical declarations and on uniqued, possibly sugared,
+/// types and live in an arena until `clear` is called at the end of the
+/// translation unit.
+class ClassNameCache {
+public:
+  explicit ClassNameCache(TemplateInstanceFilter &Instances)
+      : Instances(Instances) {}
+
+  /// look up the name for @p Key, computing it with @p Compute if needed
+  template <typename Compute>
+  StringRef lookup(const void *Key, Compute &&ComputeName) {
+    const auto It = Names.find(Key);
+    if (It != Names.end())
+      return It->second;
+
+    // computing may recursively insert other names, invalidating `It`
+    const auto Name = Saver.save(ComputeName());
+    Names[Key] = Name;
     return Name;
   }
 
-  return Cl.getNameAsString();
+  /// copy @p Name into the arena
+  StringRef save(const Twine &Name) { return Saver.save(Name); }
+
+  /// the shared decision which template instantiations are named as such
+  TemplateInstanceFilter &instances() { return Instances; }
+
+  void clear() {
+    Names.clear();
+    Arena.Reset();
+  }
+
+private:
+  TemplateInstanceFilter &Instances;
+  BumpPtrAllocator Arena;
+  StringSaver Saver{Arena};
+  DenseMap<const void *, StringRef> Names;
+};
+
+/// obtain name from some class-like entity
+///
+/// declared as a template to inhibit conversion
+/// @param v the class-like entity to work on
+/// @param cache the names computed so far in this translation unit
+template <typename T> StringRef className(const T &V, ClassNameCache &Cache);
+template <>
+StringRef className<CXXRecordDecl>(const CXXRecordDecl &, ClassNameCache &);
+template <> StringRef className<QualType>(const QualType &, ClassNameCache &);
+template <>
+StringRef className<TemplateArgument>(const TemplateArgument &,
+                                      ClassNameCache &);
+
+template <>
+StringRef className<CXXRecordDecl>(const CXXRecordDecl &Cl,
+                                   ClassNameCache &Cache) {
+  return Cache.lookup(Cl.getCanonicalDecl(), [&Cl, &Cache]() {
+    if (const auto *const T =
+            dyn_cast_or_null<ClassTemplateSpecializationDecl>(&Cl)) {
+      std::string Args;
+      const auto &TemplateArgs = T->getTemplateArgs();
+      for (unsigned I = 0; I < TemplateArgs.size(); ++I) {
+        if (I > 0)
+          Args += ", ";
+        Args += className(TemplateArgs.get(I), Cache);
+      }
+
+      // the arguments of a specialization are canonical, so equal argument
+      // lists hash alike
+      if (TemplateArgsMaxLength > 0 and Args.size() > TemplateArgsMaxLength)
+        Args = Args.substr(0, TemplateArgsMaxLength) + "...#" +
+               utohexstr(xxHash64(Args), /*LowerCase=*/true);
+
+      auto Name = Cl.getNameAsString();
+      const auto Instance = Name + "<" + Args + ">";
+      if (not Cache.instances().keep(T->getSpecializedTemplate(), Instance))
+        return Name;
+      return Instance;
+    }
+
+    return Cl.getNameAsString();
+  });
 }
-template <> std::string className<QualType>(const QualType &T) {
-  const auto &Tp = T.getTypePtrOrNull();
-  if (Tp->isReferenceType() or Tp->isPointerType()) {
-    return className(Tp->getPointeeType());
-  } else if (auto *const Cl = Tp->getAsCXXRecordDecl()) {
-    return className(*Cl);
-  }
-  return T.getAsString();
+template <>
+StringRef className<QualType>(const QualType &T, ClassNameCache &Cache) {
+  return Cache.lookup(T.getAsOpaquePtr(), [&T, &Cache]() {
+    const auto &Tp = T.getTypePtrOrNull();
+    if (Tp->isReferenceType() or Tp->isPointerType()) {
+      return className(Tp->getPointeeType(), Cache).str();
+    } else if (auto *const Cl = Tp->getAsCXXRecordDecl()) {
+      return className(*Cl, Cache).str();
+    }
+    return T.getAsString();
+  });
 }
-template <> std::string className<TemplateArgument>(const TemplateArgument &A) {
+template <>
+StringRef className<TemplateArgument>(const TemplateArgument &A,
+                                      ClassNameCache &Cache) {
   switch (A.getKind()) {
   case clang::TemplateArgument::Null:
     return "NULL";
   case clang::TemplateArgument::Type:
-    return className(A.getAsType());
+    return className(A.getAsType(), Cache);
   case clang::TemplateArgument::Integral:
-    return std::to_string(*A.getAsIntegral().getRawData());
+    return Cache.save(Twine(*A.getAsIntegral().getRawData()));
   default: // FIXME
     llvm::errs() << "No idea how to print TemplateArgument kind " +
                         std::to_string(A.getKind()) + "\n";
@@ -116,28 +637,18 @@ template <> std::string className<TemplateArgument>(const TemplateArgument &A) {
   }
 }
 
-bool recordClass(const CXXRecordDecl *Cl, const DB &Db) {
-  const auto ClassName = className(*Cl);
-  if (ClassName.empty())
+bool recordClass(const CXXRecordDecl *Cl, RecordBatch &Batch,
+                 ClassNameCache &Names) {
+  const PhaseTimer Timer(Phase::Record);
+
+  auto Record = ClassRecord{};
+  Record.Name = className(*Cl, Names).str();
+  if (Record.Name.empty())
     return false;
 
-  std::string NsName = "";
-  {
-    const auto *Context = Cl->getEnclosingNamespaceContext();
-    while (not Context->isFileContext()) {
-      if (const auto *const Ns = dyn_cast<NamespaceDecl>(Context)) {
-        const auto Name = Ns->getNameAsString();
-        NsName = Name + "::";
-        Context = Context->getEnclosingNamespaceContext();
-      } else {
-        break;
-      }
-    }
-    NsName = NsName.substr(0, NsName.size() - 2);
-  }
+  Record.Namespace = enclosingNamespace(Cl);
 
-  Db.execute("INSERT OR IGNORE INTO classes (name, namespace) VALUES ('" +
-             ClassName + "','" + NsName + "');");
+  Record.File = definitionFile(Cl);
 
   if (const auto *const Inst =
           dyn_cast_or_null<ClassTemplateSpecializationDecl>(Cl)) {
@@ -153,47 +664,40 @@ bool recordClass(const CXXRecordDecl *Cl, const DB &Db) {
         }
       }
     }
-    Db.execute("INSERT OR IGNORE INTO template_inst (instance, template, "
-               "template_args)"
-               "VALUES ('" +
-               ClassName + "','" + Inst->getNameAsString() + "','" + TmplArgs +
-               "')");
+    Record.IsTemplateInstance = true;
+    Record.Template = Inst->getNameAsString();
+    Record.TemplateArgs = std::move(TmplArgs);
   }
 
   for (auto &&Method : Cl->methods()) {
     if (Method->isImplicit())
       continue;
-    const auto &MethodName = Method->getNameAsString();
+    auto MethodRec = MethodRecord{};
+    MethodRec.Name = Method->getNameAsString();
     const auto &ReturnType = Method->getReturnType();
-    const auto &Returns = className(ReturnType);
+    MethodRec.Returns = className(ReturnType, Names).str();
     // do never document boring void types
     if (not ReturnType->isVoidType() and not ReturnType->isVoidPointerType()) {
-      Db.execute("INSERT OR IGNORE INTO uses(user, object) VALUES ('" +
-                 ClassName + "','" + Returns + "')");
+      Record.Uses.push_back(MethodRec.Returns);
     }
 
-    const auto Access = std::to_string(Method->getAccess());
+    MethodRec.Access = Method->getAccess();
 
-    std::string Parameters;
     for (unsigned I = 0; I < Method->getNumParams(); ++I) {
       const auto &Param = Method->getParamDecl(I);
       if (I > 0)
-        Parameters += ", ";
-      Parameters +=
-          className(Param->getType()) + " " + Param->getNameAsString();
-      Db.execute("INSERT OR IGNORE INTO uses(user, object) VALUES ('" +
-                 ClassName + "','" + className(Param->getType()) + "')");
+        MethodRec.Parameters += ", ";
+      const auto ParamType = className(Param->getType(), Names);
+      MethodRec.Parameters += ParamType;
+      MethodRec.Parameters += " ";
+      MethodRec.Parameters += Param->getNameAsString();
+      Record.Uses.push_back(ParamType.str());
     }
 
-    const std::string IsStatic = std::to_string(Method->isStatic());
-    const std::string IsAbstract = std::to_string(Method->isPure());
+    MethodRec.IsStatic = Method->isStatic();
+    MethodRec.IsAbstract = Method->isPure();
 
-    if (not Db.execute("INSERT OR IGNORE INTO methods (class, name, returns, "
-                       "parameters, access, static, abstract) VALUES ('" +
-                       ClassName + "','" + MethodName + "','" + Returns +
-                       "','" + Parameters + "'," + Access + "," + IsStatic +
-                       "," + IsAbstract + ");"))
-      return false;
+    Record.Methods.emplace_back(std::move(MethodRec));
   }
 
   // record member variables
@@ -201,173 +705,774 @@ bool recordClass(const CXXRecordDecl *Cl, const DB &Db) {
     if (Field->isImplicit())
       continue;
     if (auto *const D = Field->getType()->getAsCXXRecordDecl()) {
-      const auto &FieldType = className(*D);
-      const auto &FieldName = Field->getNameAsString();
-
-      if (not Db.execute(
-              "INSERT OR IGNORE INTO owns (owner, object, name) VALUES ('" +
-              className(*Cl) + "','" + FieldType + "','" + FieldName + "')"))
-        return false;
+      Record.Fields.push_back(
+          FieldRecord{className(*D, Names).str(), Field->getNameAsString()});
     }
   }
 
+  Batch.Classes.emplace_back(std::move(Record));
+  count(Counter::ClassesRecorded);
+
   return true;
 }
 
-bool recordBases(const CXXRecordDecl *Base, const BaseCallbackData &Data) {
-  const auto *const Derived = Data.Derived;
-  assert(Derived);
-
-  recordClass(Base, *Data.Db);
-
-  const auto IsDirectBase = [](const CXXRecordDecl *Base,
-                               const CXXRecordDecl *Derived) {
-    return std::find_if(Derived->bases_begin(), Derived->bases_end(),
-                        [&Base](const CXXBaseSpecifier &BaseSp) {
-                          const auto &Name1 =
-                              BaseSp.getType()->getAsCXXRecordDecl()->getName();
-                          const auto &Name2 = Base->getName();
-                          return Name1 == Name2;
-                        }) != Derived->bases_end();
-  };
+/// the definition to record for the class @p Cl
+///
+/// Instantiations named as their template are recorded as the template, if
+/// it is defined.
+const CXXRecordDecl *recordedDefinition(const CXXRecordDecl *Cl,
+                                        ClassNameCache &Names) {
+  const auto *const Inst = dyn_cast<ClassTemplateSpecializationDecl>(Cl);
+  if (not Inst or className(*Cl, Names) != Inst->getName())
+    return Cl;
+  return Inst->getSpecializedTemplate()->getTemplatedDecl()->getDefinition();
+}
 
-  if (IsDirectBase(Base, Derived)) {
-    Data.Db->execute(
-        "INSERT OR IGNORE INTO inheritance (derived, base) VALUES ('" +
-        className(*Derived) + "','" + className(*Base) + "')");
-    const auto NewData = BaseCallbackData{Base, Data.Db};
-    Base->forallBases([&NewData](const CXXRecordDecl *Base) {
-      return recordBases(Base, NewData);
-    });
-  }
+/// record a class and all its transitive bases
+///
+/// Every class of the hierarchy and every direct base edge is visited once,
+/// also for diamonds; bases recorded before are not walked again.
+void walkHierarchy(const CXXRecordDecl *Derived, RecordWriter &Writer,
+                   RecordedClasses &Recorded, ClassNameCache &Names) {
+  Derived = recordedDefinition(Derived, Names);
+  if (not Derived or not Recorded.insert(*Derived))
+    return;
 
-  return true;
-}
+  auto Batch = RecordBatch{};
 
-void walkHierarchy(const CXXRecordDecl *Derived, const DB &Db) {
-  const auto Data = BaseCallbackData{Derived, &Db};
-  Derived->forallBases(
-      [&Data](const CXXRecordDecl *Base) { return recordBases(Base, Data); });
+  SmallPtrSet<const CXXRecordDecl *, 16> Visited{Derived->getCanonicalDecl()};
+  SmallVector<const CXXRecordDecl *, 16> Worklist{Derived};
 
-  recordClass(Derived, Db);
+  while (not Worklist.empty()) {
+    const auto *const Cl = Worklist.pop_back_val();
+    const auto DerivedName = className(*Cl, Names);
+    const auto DerivedFile = definitionFile(Cl);
+
+    for (const auto &BaseSp : Cl->bases()) {
+      const auto *Base = BaseSp.getType()->getAsCXXRecordDecl();
+      if (not Base or not Base->hasDefinition())
+        continue; // e.g. a dependent base
+      Base = Base->getDefinition();
+
+      Batch.Inheritance.push_back(InheritanceRecord{
+          DerivedName.str(), className(*Base, Names).str(), DerivedFile});
+
+      // a recorded class has had its bases recorded as well
+      Base = recordedDefinition(Base, Names);
+      if (Base and Visited.insert(Base->getCanonicalDecl()).second and
+          Recorded.insert(*Base))
+        Worklist.push_back(Base);
+    }
+
+    recordClass(Cl, Batch, Names);
+  }
+
+  Writer.push(std::move(Batch));
 }
 
 class UmlerCallback : public MatchFinder::MatchCallback {
 public:
-  explicit UmlerCallback(const DB &Db) : Db(Db) {}
+  UmlerCallback(RecordWriter &Writer, RecordedClasses &Recorded,
+                TemplateInstanceFilter &Instances)
+      : Writer(Writer), Recorded(Recorded), Names(Instances) {}
 
   void run(const MatchFinder::MatchResult &Result) override {
     const auto *const Node = Result.Nodes.getNodeAs<CXXRecordDecl>("node");
 
-    walkHierarchy(Node, Db);
+    count(Counter::Matches);
+    walkHierarchy(Node, Writer, Recorded, Names);
+  }
+
+  void onStartOfTranslationUnit() override { Matching.emplace(Phase::Match); }
+
+  void onEndOfTranslationUnit() override {
+    Names.clear();
+    Matching.reset();
   }
 
   // private:
-  const DB &Db;
+  RecordWriter &Writer;
+  RecordedClasses &Recorded;
+  ClassNameCache Names;
+  std::optional<PhaseTimer> Matching;
 };
 
-/// helper for build_nested_namespace_matchers
-template <typename Iterable>
-auto helperBuildNestedNamespaceMatchers(const StringRef &Head,
-                                        const Iterable &Tail)
-    -> decltype(namespaceDecl()) {
-  if (not Tail.size()) { // bottom condition
-    return namespaceDecl(hasName(Head.str()));
+/// the memory held by the parse of the translation unit of @p CI
+///
+/// Sums the allocations of the AST, the preprocessor and the source manager,
+/// which make up nearly all of it, since the resident memory of the process
+/// cannot be attributed to translation units parsed in parallel.
+uint64_t parseMemory(CompilerInstance &CI) {
+  uint64_t Bytes = 0;
+  if (CI.hasASTContext()) {
+    const auto &Context = CI.getASTContext();
+    Bytes += Context.getASTAllocatedMemory() +
+             Context.getSideTableAllocatedMemory();
+  }
+  if (CI.hasPreprocessor())
+    Bytes += CI.getPreprocessor().getTotalMemory();
+  if (CI.hasSourceManager()) {
+    const auto &SM = CI.getSourceManager();
+    const auto Buffers = SM.getMemoryBufferSizes();
+    Bytes += SM.getContentCacheSize() + SM.getDataStructureSizes() +
+             Buffers.malloc_bytes + Buffers.mmap_bytes;
+  }
+  return Bytes;
+}
+
+/// collect the files read by each translation unit for incremental runs, and
+/// what parsing it took
+class TranslationUnitTracker : public SourceFileCallbacks {
+public:
+  TranslationUnitTracker(RecordWriter &Writer, FileHashes &Hashes)
+      : Writer(Writer), Hashes(Hashes) {}
+
+  /// set up tracking of the next translation unit
+  ///
+  /// @param Path the key of the translation unit, see `translationUnitPath`
+  /// @param CommandHash the hash of its compile command and settings
+  /// @param Precompiled the files read by its precompiled header, if any
+  void start(std::string Path, uint64_t CommandHash,
+             const std::vector<std::string> *Precompiled) {
+    this->Path = std::move(Path);
+    this->CommandHash = CommandHash;
+    this->Precompiled = Precompiled;
   }
 
-  const auto &NewHead = *Tail.begin();
-  const auto NewTail = Iterable(std::next(Tail.begin()), Tail.end());
+  bool handleBeginSource(CompilerInstance &CI) override {
+    Instance = &CI;
+    Started = std::chrono::steady_clock::now();
+    return true;
+  }
+
+  void handleEndSource() override {
+    // a translation unit which failed to parse, e.g. for a missing header
+    // not among its dependencies, is parsed again by the next run instead
+    if (Instance->getDiagnostics().hasErrorOccurred())
+      return;
 
-  return namespaceDecl(
-      hasName(Head.str()),
-      hasAncestor(helperBuildNestedNamespaceMatchers(NewHead, NewTail)));
+    auto Unit = TranslationUnitRecord{Path, CommandHash, {}, {}};
+    Unit.Cost.Memory = static_cast<int64_t>(parseMemory(*Instance));
+    Unit.Cost.Milliseconds =
+        std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - Started)
+            .count();
+
+    const auto &SM = Instance->getSourceManager();
+    for (auto It = SM.fileinfo_begin(); It != SM.fileinfo_end(); ++It) {
+      auto File = absolutePath(SM.getFileManager(), It->first->getName());
+      if (const auto Hash = Hashes.get(File))
+        Unit.Dependencies.emplace_back(std::move(File),
+                                       static_cast<int64_t>(*Hash));
+    }
+
+    // files only read through a precompiled header may not be listed
+    if (Precompiled)
+      for (const auto &File : *Precompiled)
+        if (const auto Hash = Hashes.get(File))
+          Unit.Dependencies.emplace_back(File, static_cast<int64_t>(*Hash));
+
+    auto Batch = RecordBatch{};
+    Batch.TranslationUnits.emplace_back(std::move(Unit));
+    Writer.push(std::move(Batch));
+  }
+
+private:
+  RecordWriter &Writer;
+  FileHashes &Hashes;
+
+  std::string Path;
+  uint64_t CommandHash = 0;
+  const std::vector<std::string> *Precompiled = nullptr;
+  CompilerInstance *Instance = nullptr;
+  std::chrono::steady_clock::time_point Started;
+};
+
+/// restrict the traversal of a translation unit to the top-level
+/// declarations in files accepted by a filter
+///
+/// Consumers after this one, like the match finder's, then never visit the
+/// declarations in other files at all.
+class TraversalScopeConsumer : public ASTConsumer {
+public:
+  explicit TraversalScopeConsumer(const FileFilter &Filter) : Filter(Filter) {}
+
+  void HandleTranslationUnit(ASTContext &Context) override {
+    const auto &SM = Context.getSourceManager();
+
+    std::vector<Decl *> Scope;
+    DenseMap<FileID, bool> Accepted;
+    for (auto *const D : Context.getTranslationUnitDecl()->decls()) {
+      const auto File = SM.getFileID(SM.getExpansionLoc(D->getLocation()));
+      auto It = Accepted.find(File);
+      if (It == Accepted.end())
+        It = Accepted.try_emplace(File, Filter.accepts(SM, File)).first;
+      if (It->second)
+        Scope.push_back(D);
+    }
+
+    Context.setTraversalScope(Scope);
+  }
+
+private:
+  const FileFilter &Filter;
+};
+
+/// run an action with its traversal restricted to the files accepted by a
+/// filter
+class FilteringAction : public WrapperFrontendAction {
+public:
+  FilteringAction(std::unique_ptr<FrontendAction> Wrapped,
+                  const FileFilter &Filter)
+      : WrapperFrontendAction(std::move(Wrapped)), Filter(Filter) {}
+
+protected:
+  std::unique_ptr<ASTConsumer> CreateASTConsumer(CompilerInstance &CI,
+                                                 StringRef InFile) override {
+    auto Wrapped = WrapperFrontendAction::CreateASTConsumer(CI, InFile);
+    if (not Wrapped)
+      return nullptr;
+
+    std::vector<std::unique_ptr<ASTConsumer>> Consumers;
+    Consumers.push_back(std::make_unique<TraversalScopeConsumer>(Filter));
+    Consumers.push_back(std::move(Wrapped));
+    return std::make_unique<MultiplexConsumer>(std::move(Consumers));
+  }
+
+private:
+  const FileFilter &Filter;
+};
+
+/// create frontend actions, tuning each invocation for extraction
+class UmlerActionFactory : public FrontendActionFactory {
+public:
+  UmlerActionFactory(std::unique_ptr<FrontendActionFactory> Wrapped,
+                     const FileFilter &Filter)
+      : Wrapped(std::move(Wrapped)), Filter(Filter) {}
+
+  std::unique_ptr<FrontendAction> create() override {
+    auto Action = Wrapped->create();
+    if (Filter.acceptsAll())
+      return Action;
+    return std::make_unique<FilteringAction>(std::move(Action), Filter);
+  }
+
+  bool runInvocation(std::shared_ptr<CompilerInvocation> Invocation,
+                     FileManager *Files,
+                     std::shared_ptr<PCHContainerOperations> PCHContainerOps,
+                     DiagnosticConsumer *DiagConsumer) override {
+    if (SkipFunctionBodies) {
+      // only declarations are recorded, so neither bodies nor the warnings
+      // computed from them are needed
+      Invocation->getFrontendOpts().SkipFunctionBodies = true;
+      Invocation->getDiagnosticOpts().IgnoreWarnings = true;
+    }
+    // free the AST once its records are emitted rather than at exit, so that
+    // memory budgets hold for the translation units still being parsed
+    Invocation->getFrontendOpts().DisableFree = false;
+
+    return FrontendActionFactory::runInvocation(
+        std::move(Invocation), Files, std::move(PCHContainerOps),
+        DiagConsumer);
+  }
+
+private:
+  std::unique_ptr<FrontendActionFactory> Wrapped;
+  const FileFilter &Filter;
+};
+
+/// the classes requested with `-c`, indexed by their unqualified name
+///
+/// Like `hasName`, names may be partially qualified: `b::X` matches a class
+/// `X` declared in any namespace or class `b`, while `::b::X` only matches one
+/// in a top-level `b`. Inline namespaces need not be named. Candidates are
+/// looked up by their identifier first, so most classes are rejected without
+/// walking their scopes, whatever the number of requested names.
+class RequestedClasses {
+public:
+  explicit RequestedClasses(ArrayRef<std::string> Names) {
+    for (StringRef Name : Names) {
+      auto Requested = Qualifier{};
+      Requested.FullyQualified = Name.consume_front("::");
+
+      SmallVector<StringRef, 4> Components;
+      Name.split(Components, "::");
+      const auto Unqualified = Components.pop_back_val();
+
+      // innermost scope first, matching the walk up the declaration contexts
+      for (auto It = Components.rbegin(); It != Components.rend(); ++It)
+        Requested.Scopes.push_back(It->str());
+
+      ByName[Unqualified].push_back(std::move(Requested));
+    }
+  }
+
+  /// whether @p Record is one of the requested classes
+  bool matches(const RecordDecl &Record) const {
+    const auto *const Identifier = Record.getIdentifier();
+    if (not Identifier)
+      return false;
+
+    const auto It = ByName.find(Identifier->getName());
+    if (It == ByName.end())
+      return false;
+
+    return llvm::any_of(It->second, [&Record](const Qualifier &Requested) {
+      return matchesScopes(Record.getDeclContext(), Requested);
+    });
+  }
+
+private:
+  struct Qualifier {
+    bool FullyQualified = false;
+    SmallVector<std::string, 4> Scopes;
+  };
+
+  static bool matchesScopes(const DeclContext *Context,
+                            const Qualifier &Requested) {
+    auto Scope = Requested.Scopes.begin();
+    for (;; Context = Context->getParent()) {
+      if (Scope == Requested.Scopes.end() and not Requested.FullyQualified)
+        return true;
+      if (not Context or Context->isTranslationUnit())
+        return Scope == Requested.Scopes.end();
+      if (Context->isTransparentContext())
+        continue;
+
+      const auto *const Named =
+          dyn_cast<NamedDecl>(Decl::castFromDeclContext(Context));
+      const auto *const Identifier = Named ? Named->getIdentifier() : nullptr;
+      if (Scope != Requested.Scopes.end() and Identifier and
+          Identifier->getName() == *Scope)
+        ++Scope;
+      else if (not Context->isInlineNamespace())
+        return false;
+    }
+  }
+
+  StringMap<SmallVector<Qualifier, 1>> ByName;
+};
+
+/// matches the classes in a `RequestedClasses` index
+AST_MATCHER_P(RecordDecl, isRequestedClass, const RequestedClasses *,
+              Requested) {
+  return Requested->matches(Node);
+}
+
+/// register the matchers for the requested classes
+///
+/// @param Finder the match finder to populate
+/// @param Callback the callback invoked for every matched class
+/// @param Requested the classes requested with `-c`; must outlive @p Finder
+void addMatchers(MatchFinder &Finder, UmlerCallback &Callback,
+                 const RequestedClasses &Requested) {
+  if (ClassName.empty()) {
+    Finder.addMatcher(
+        recordDecl(anything(), isDefinition(), unless(isImplicit()))
+            .bind("node"),
+        &Callback);
+    return;
+  }
+
+  // a single matcher for all names, rejecting most classes by a hash lookup
+  Finder.addMatcher(recordDecl(isRequestedClass(&Requested), isDefinition(),
+                               unless(isImplicit()))
+                        .bind("node"),
+                    &Callback);
+}
+
+/// order sources so that the most expensive translation units start first
+///
+/// Translation units are ordered by the time they took in earlier runs, as
+/// recorded in @p Costs. Those never parsed before go first, ordered by the
+/// size of their main file as a cheap proxy for parse cost. Starting large
+/// TUs early keeps workers from idling behind a single straggler.
+std::vector<std::string>
+scheduleSources(std::vector<std::string> Sources,
+                const StringMap<TranslationUnitCost> &Costs) {
+  struct Entry {
+    bool Known;
+    uint64_t Cost;
+    std::string Source;
+  };
+
+  std::vector<Entry> Entries;
+  Entries.reserve(Sources.size());
+  for (auto &Source : Sources) {
+    const auto It = Costs.find(translationUnitPath(Source));
+    if (It != Costs.end()) {
+      Entries.push_back({true, static_cast<uint64_t>(It->second.Milliseconds),
+                         std::move(Source)});
+      continue;
+    }
+
+    uint64_t Size = 0;
+    if (sys::fs::file_size(Source, Size))
+      Size = 0;
+    Entries.push_back({false, Size, std::move(Source)});
+  }
+
+  std::stable_sort(Entries.begin(), Entries.end(),
+                   [](const Entry &A, const Entry &B) {
+                     if (A.Known != B.Known)
+                       return not A.Known;
+                     return A.Cost > B.Cost;
+                   });
+
+  std::vector<std::string> Result;
+  Result.reserve(Entries.size());
+  for (auto &E : Entries)
+    Result.emplace_back(std::move(E.Source));
+  return Result;
 }
 
-/// build a matcher from a list of namespaces
-//
-/// e.g. given a list {"n1", "n2", "n3"} this would match
-/// namespace n1 { namespace n2 { namespace n3 /* MATCH */ { } } }
+/// hands out translation units to workers in order, starting each only once
+/// its memory fits into a budget next to those being parsed
+///
+/// Translation units are not reordered to fill the budget, so a large one is
+/// never held back by smaller ones. One needing more than the whole budget
+/// is parsed alone.
+class TranslationUnitQueue {
+public:
+  /// @param Memory the memory estimated for each translation unit in bytes
+  /// @param Budget the memory available in bytes; 0 for no limit
+  TranslationUnitQueue(std::vector<uint64_t> Memory, uint64_t Budget)
+      : Memory(std::move(Memory)), Budget(Budget) {}
+
+  /// wait for the next translation unit to fit into the budget
+  ///
+  /// @returns its index, or nothing once all were handed out
+  std::optional<size_t> pop() {
+    std::unique_lock<std::mutex> Lock(Mutex);
+    const auto Fits = [this]() {
+      return Next >= Memory.size() or Running == 0 or
+             InUse + Memory[Next] <= Budget;
+    };
+    if (Budget > 0 and not Fits()) {
+      const PhaseTimer Timer(Phase::WaitForMemory);
+      Available.wait(Lock, Fits);
+    }
+
+    if (Next >= Memory.size())
+      return std::nullopt;
+    InUse += Memory[Next];
+    ++Running;
+    return Next++;
+  }
+
+  /// return the memory of the translation unit at @p Index once parsed
+  void done(size_t Index) {
+    {
+      const std::lock_guard<std::mutex> Lock(Mutex);
+      InUse -= Memory[Index];
+      --Running;
+    }
+    Available.notify_all();
+  }
+
+private:
+  const std::vector<uint64_t> Memory;
+  const uint64_t Budget;
+
+  std::mutex Mutex;
+  std::condition_variable Available;
+  size_t Next = 0;
+  size_t Running = 0;
+  uint64_t InUse = 0;
+};
+
+/// select the sources of a shard from a `-shard` value `i/N`
+///
+/// Sources are assigned by a hash of their path so that runs given the same
+/// sources on different machines parse disjoint sets covering all of them.
 ///
-/// @param namespaces a non-empty iterable of namespace name strings
-/// @pre namespaces is not empty
-/// @returns a matcher for the most nested name
-template <typename Iterable>
-auto buildNestedNamespaceMatchers(const Iterable &Namespaces)
-    -> decltype(namespaceDecl()) {
-  // we iterate over the names reversed to build the matcher from the bottom up
-  const auto &Head = *Namespaces.rbegin();
-  const auto Tail = Iterable(std::next(Namespaces.rbegin()), Namespaces.rend());
-
-  return helperBuildNestedNamespaceMatchers(Head, Tail);
+/// @returns false if @p Spec is malformed
+bool shardSources(StringRef Spec, std::vector<std::string> &Sources) {
+  const auto Parts = Spec.split('/');
+  unsigned Index = 0;
+  unsigned Count = 0;
+  if (Parts.first.getAsInteger(10, Index) or
+      Parts.second.getAsInteger(10, Count) or Count == 0 or Index >= Count)
+    return false;
+
+  Sources.erase(std::remove_if(Sources.begin(), Sources.end(),
+                               [&](const std::string &Source) {
+                                 return xxHash64(Source) % Count != Index;
+                               }),
+                Sources.end());
+  return true;
 }
 
-/// extract the namespaces in some class name
-/// @param full_name the class name, possibly including namespaces
-SmallVector<StringRef, 1000>
-extractNamespaceComponents(const StringRef &FullName) {
-  decltype(extractNamespaceComponents("")) Namespaces;
+/// parse all sources on a pool of worker threads
+///
+/// Every worker owns its own tool and match finder and pulls the next
+/// translation unit from a shared queue; records go to the shared @p Writer.
+///
+/// @param MemoryBudget bytes the translation units parsed at a time may take
+/// by @p Costs, 0 for no limit; unrecorded ones are assumed to take as much
+/// as the largest recorded one
+/// @param Costs what parsing translation units took in earlier runs, by path
+/// @param Hashes if set, the files read by each translation unit are recorded
+/// for incremental runs
+/// @param Pchs if set, the precompiled headers to parse sources with
+/// @returns non-zero if any translation unit failed to parse
+int extract(const CompilationDatabase &Compilations,
+            const std::vector<std::string> &Sources, RecordWriter &Writer,
+            unsigned NumJobs, uint64_t MemoryBudget,
+            const StringMap<TranslationUnitCost> &Costs, FileHashes *Hashes,
+            PrecompiledHeaders *Pchs) {
+  const auto Scheduled = scheduleSources(Sources, Costs);
+
+  uint64_t Largest = 0;
+  for (const auto &Entry : Costs)
+    Largest = std::max(Largest, static_cast<uint64_t>(Entry.second.Memory));
+  std::vector<uint64_t> Memory;
+  Memory.reserve(Scheduled.size());
+  for (const auto &Source : Scheduled) {
+    const auto It = Costs.find(translationUnitPath(Source));
+    Memory.push_back(It != Costs.end()
+                         ? static_cast<uint64_t>(It->second.Memory)
+                         : Largest);
+  }
+  TranslationUnitQueue Queue(std::move(Memory), MemoryBudget);
+
+  if (NumJobs == 0)
+    NumJobs = std::max(1u, std::thread::hardware_concurrency());
+  NumJobs = std::max<size_t>(1, std::min<size_t>(NumJobs, Scheduled.size()));
+
+  std::atomic<int> Result{0};
+  RecordedClasses Recorded;
+  TemplateInstanceFilter Instances(TemplateInstances, TemplateInstanceCap);
+
+  const auto Worker = [&]() {
+    const ThreadTrace Trace;
+    ast_matchers::MatchFinder Finder;
+    auto Callback = UmlerCallback{Writer, Recorded, Instances};
+    const RequestedClasses Requested(ClassName);
+    addMatchers(Finder, Callback, Requested);
+
+    std::unique_ptr<TranslationUnitTracker> Tracker;
+    if (Hashes)
+      Tracker = std::make_unique<TranslationUnitTracker>(Writer, *Hashes);
+    const FileFilter Filter;
+    auto Factory = UmlerActionFactory{
+        newFrontendActionFactory(&Finder, Tracker.get()), Filter};
+    const auto Settings = extractionSettings();
 
-  // we split at `::`
-  FullName.split(Namespaces, "::");
+    // tools change their file system's working directory to the one of the
+    // compile command; give each worker its own instead of the process-wide
+    // one so concurrent translation units do not race on it
+    IntrusiveRefCntPtr<vfs::FileSystem> FS(
+        vfs::createPhysicalFileSystem().release());
 
-  // last element is always a class name
-  Namespaces.pop_back();
+    while (const auto Next = Queue.pop()) {
+      const auto I = *Next;
+      count(Counter::TranslationUnits);
+      const PhaseTimer Timer(Phase::TranslationUnit, Scheduled[I]);
+      const auto *Pch = Pchs ? Pchs->get(Scheduled[I], FS) : nullptr;
 
-  // remove empty ns names, e.g. from a ::ns::ClassName
-  Namespaces.erase(std::remove_if(Namespaces.begin(), Namespaces.end(),
-                                  [](const StringRef &S) { return S.empty(); }),
-                   Namespaces.end());
+      if (Tracker)
+        Tracker->start(translationUnitPath(Scheduled[I]),
+                       commandHash(Compilations, Scheduled[I], Settings),
+                       Pch ? &Pch->Dependencies : nullptr);
 
-  return Namespaces;
+      ClangTool Tool(Compilations, Scheduled[I],
+                     std::make_shared<PCHContainerOperations>(), FS);
+      if (Pch)
+        Tool.appendArgumentsAdjuster(getInsertArgumentAdjuster(
+            {"-include-pch", Pch->Path}, ArgumentInsertPosition::BEGIN));
+      if (const auto Status = Tool.run(&Factory))
+        Result = Status;
+      Queue.done(I);
+    }
+  };
+
+  if (NumJobs == 1) {
+    Worker();
+  } else {
+    std::vector<std::thread> Workers;
+    Workers.reserve(NumJobs);
+    for (unsigned I = 0; I < NumJobs; ++I)
+      Workers.emplace_back(Worker);
+    for (auto &W : Workers)
+      W.join();
+  }
+
+  auto Batch = RecordBatch{};
+  Batch.CountedInstances = Instances.counted();
+  if (not Batch.CountedInstances.empty())
+    Writer.push(std::move(Batch));
+
+  return Result;
 }
 
 } // end anonymous namespace
 
 int main(int argc, const char **argv) {
   llvm::sys::PrintStackTraceOnErrorSignal(argv[0]);
-  auto OptionsParser = CommonOptionsParser::create(argc, argv, UmlerCategory);
+  // sources are optional when merging or reporting an existing database
+  auto OptionsParser = CommonOptionsParser::create(argc, argv, UmlerCategory,
+                                                   cl::ZeroOrMore);
 
   if (auto Error = OptionsParser.takeError()) {
-    llvm::errs() << "Could not parse options";
+    llvm::errs() << "COULD NOT PARSE OPTIONS: " << toString(std::move(Error))
+                 << "\n";
+    return 1;
   }
 
-  RefactoringTool Tool(OptionsParser->getCompilations(),
-                       OptionsParser->getSourcePathList());
-  ast_matchers::MatchFinder Finder;
+  if (PrintStats)
+    enableStats();
+  if (not StatsTrace.empty())
+    enableTrace(StatsTraceGranularity);
 
-  const auto Db = DB{DBPath.getValue()};
-  auto Callback = UmlerCallback{Db};
+  // comparing against an empty database in memory is never meant
+  if (not DiffDB.empty() and DBPath.getNumOccurrences() == 0) {
+    llvm::errs() << "-diff REQUIRES -d\n";
+    return 1;
+  }
 
-  if (ClassName.empty()) {
-    Finder.addMatcher(
-        recordDecl(anything(), isDefinition(), unless(isImplicit()))
-            .bind("node"),
-        &Callback);
-  } else {
-    for (const auto &Name : ClassName) {
-      const auto Namespaces = extractNamespaceComponents(Name);
-      if (not Namespaces.size()) {
-        Finder.addMatcher(
-            recordDecl(hasName(Name), isDefinition(), unless(isImplicit()))
-                .bind("node"),
-            &Callback);
-      } else {
-        auto NamespaceMatcher = buildNestedNamespaceMatchers(Namespaces);
-        Finder.addMatcher(recordDecl(hasName(Name), isDefinition(),
-                                     unless(isImplicit()),
-                                     hasAncestor(NamespaceMatcher))
-                              .bind("node"),
-                          &Callback);
-      }
+  // records of runs which neither persist, merge nor compare them only live
+  // as long as the report needs them, so they are kept in memory without a
+  // database
+  const auto InMemory = DBPath == ":memory:" and MergeDBs.empty() and
+                        ServeSocket.empty() and DiffDB.empty();
+  const ClassGraph Graph;
+  std::optional<DB> Db;
+  if (not InMemory) {
+    auto DbOptions = DB::Options{};
+    DbOptions.JournalMode = DBJournalMode.getValue();
+    DbOptions.Synchronous = DBSynchronous.getValue();
+    DbOptions.BatchSize = std::max(1u, DBBatchSize.getValue());
+    Db.emplace(DBPath.getValue(), DbOptions);
+  }
+  const Storage &Store = InMemory ? static_cast<const Storage &>(Graph) : *Db;
+
+  for (const auto &Path : MergeDBs)
+    if (not Db->merge(Path))
+      return 1;
+
+  // opened before parsing so that a bad path fails early; reports are large
+  // and written in many small pieces, so they are buffered generously
+  std::error_code EC;
+  llvm::raw_fd_ostream Output(OutputPath, EC, llvm::sys::fs::OF_None);
+  if (EC) {
+    llvm::errs() << "COULD NOT OPEN " << OutputPath << ": " << EC.message()
+                 << "\n";
+    return 1;
+  }
+  Output.SetBufferSize(ReportBufferSize);
+
+  // without sources no compilation database is set up, and none is needed
+  auto Sources = OptionsParser->getSourcePathList();
+  const auto HasSources = not Sources.empty();
+
+  if (not Shard.empty() and not shardSources(Shard, Sources)) {
+    llvm::errs() << "INVALID SHARD " << Shard << ", expected i/N\n";
+    return 1;
+  }
+
+  const auto Kind = ReportKind{.DocumentOwns = DocumentOwns.getValue(),
+                               .DocumentUses = DocumentUses.getValue(),
+                               .DocumentBinds = DocumentBinds.getValue(),
+                               .DocumentMethods = DocumentMethods.getValue(),
+                               .Type = Format.getValue(),
+                               .Roots = ClassName,
+                               .Depth = ReportDepth.getValue()};
+
+  // what translation units took in earlier runs orders them and bounds the
+  // memory of those parsed at a time
+  const auto Budget = static_cast<uint64_t>(MemoryBudget.getValue()) << 20;
+  auto Costs = StringMap<TranslationUnitCost>{};
+
+  auto Hashes = FileHashes{};
+  if (not ServeSocket.empty()) {
+    if (not Incremental) {
+      llvm::errs() << "-serve REQUIRES -incremental\n";
+      return 1;
     }
+
+    if (HasSources and PrefilterSources and not ClassName.empty())
+      Sources = prefilterSources(OptionsParser->getCompilations(), Sources,
+                                 ClassName);
+
+    // the compilation database, file hashes and result database stay loaded
+    // between updates
+    const auto Settings = extractionSettings();
+    const auto Update = [&](const std::vector<std::string> &Changed) {
+      for (const auto &Path : Changed)
+        Hashes.invalidate(Path);
+      if (not HasSources)
+        return;
+
+      const auto &Compilations = OptionsParser->getCompilations();
+      const auto Selected = selectChangedSources(Compilations, Sources, *Db,
+                                                 Settings, Hashes);
+      // rebuilt per update as changed headers make precompiled ones stale
+      std::optional<PrecompiledHeaders> Pchs;
+      if (not PchCache.empty())
+        Pchs.emplace(Compilations, Selected, PchCache, PchMinSources);
+
+      Db->lookupTranslationUnitCosts(Costs);
+      auto Writer = RecordWriter{*Db};
+      extract(Compilations, Selected, Writer, Jobs.getValue(), Budget, Costs,
+              &Hashes, Pchs ? &*Pchs : nullptr);
+      Writer.finish();
+    };
+
+    return serve(ServeSocket, *Db, Kind, Update) ? 0 : 1;
   }
 
-  const auto FrontendResult = Tool.run(newFrontendActionFactory(&Finder).get());
+  int FrontendResult = 0;
+  if (HasSources) {
+    const auto &Compilations = OptionsParser->getCompilations();
+
+    // selecting purges the records of changed files, which only the sources
+    // parsed afterwards record again, so sources are filtered first
+    if (PrefilterSources and not ClassName.empty()) {
+      const PhaseTimer Timer(Phase::Prefilter);
+      Sources = prefilterSources(Compilations, Sources, ClassName);
+    }
+
+    if (trackFiles()) {
+      const PhaseTimer Timer(Phase::SelectSources);
+      Sources = selectChangedSources(Compilations, Sources, *Db,
+                                     extractionSettings(), Hashes);
+    }
+
+    std::optional<PrecompiledHeaders> Pchs;
+    if (not PchCache.empty())
+      Pchs.emplace(Compilations, Sources, PchCache, PchMinSources);
+
+    if (Db)
+      Db->lookupTranslationUnitCosts(Costs);
+
+    auto Writer = RecordWriter{Store};
+    FrontendResult = extract(Compilations, Sources, Writer, Jobs.getValue(),
+                             Budget, Costs, trackFiles() ? &Hashes : nullptr,
+                             Pchs ? &*Pchs : nullptr);
+    Writer.finish();
+  }
+
+  {
+    const PhaseTimer Timer(Phase::Report);
+    if (DiffDB.empty()) {
+      report(Store, Kind, Output);
+    } else if (not sys::fs::exists(DiffDB)) {
+      llvm::errs() << "COULD NOT OPEN " << DiffDB << "\n";
+      return 1;
+    } else {
+      // the baseline is only read, whatever version wrote it
+      auto OldOptions = DB::Options{};
+      OldOptions.ReadOnly = true;
+      const DB Old(DiffDB, OldOptions);
+      if (not Old.connection or
+          not diff(Old, *Db, DiffDiagram, Format.getValue(), Output))
+        return 1;
+    }
+  }
 
-  report(Db, {.DocumentOwns = DocumentOwns.getValue(),
-              .DocumentUses = DocumentUses.getValue(),
-              .DocumentBinds = DocumentBinds.getValue(),
-              .DocumentMethods = DocumentMethods.getValue()});
+  printStats(llvm::errs());
+  writeTrace(StatsTrace);
 
   return FrontendResult;
 }
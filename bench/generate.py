@@ -0,0 +1,156 @@
+#!/usr/bin/env python3
+"""Generate a synthetic C++ code base with a compilation database.
+
+The shape of the code base is controlled by a few knobs:
+
+* `--headers` headers, each defining `--classes` classes in its own namespace
+  and a class template instantiated by the classes of the headers including it,
+* every header includes its predecessor unless it starts a new hierarchy every
+  `--depth` headers; its classes derive from `--width` classes of that
+  predecessor, virtually if there is more than one,
+* each class owns `--instantiations` instantiations of its predecessor's
+  template over the predecessor's classes, and has `--methods` methods taking
+  and returning classes of the predecessor,
+* `--tus` translation units each include `--includes` headers.
+
+The output only depends on the knobs and `--seed`, so workloads can be
+regenerated to compare runs.
+
+    % bench/generate.py --tus 100 --headers 100 out/
+"""
+
+import argparse
+import json
+import os
+import random
+
+
+def header_name(h):
+    return 'h{}.hpp'.format(h)
+
+
+def class_name(h, c):
+    return 'n{}::C{}'.format(h, c)
+
+
+def write_header(path, h, args, rng):
+    """Write header `h`, deriving from its predecessor unless it is a root."""
+    base = h - 1 if h % args.depth else None
+    with open(path, 'w') as out:
+        out.write('#pragma once\n')
+        if base is not None:
+            out.write('#include "{}"\n'.format(header_name(base)))
+        out.write('namespace n{} {{\n'.format(h))
+        out.write('template <typename T> struct Holder {\n')
+        # a pointer keeps object sizes from growing with hierarchy depth
+        out.write('  T *value = nullptr;\n')
+        out.write('  T &get() const { return *value; }\n')
+        out.write('};\n')
+
+        for c in range(args.classes):
+            bases = []
+            others = []
+            if base is not None:
+                picks = rng.sample(range(args.classes),
+                                   min(args.width, args.classes))
+                # share bases reached on several paths
+                access = 'public virtual' if args.width > 1 else 'public'
+                bases = ['{} ::{}'.format(access, class_name(base, p))
+                         for p in picks]
+                others = [class_name(base, rng.randrange(args.classes))
+                          for _ in range(max(args.instantiations,
+                                             args.methods))]
+            out.write('struct C{}{} {{\n'.format(
+                c, ' : ' + ', '.join(bases) if bases else ''))
+            for i, other in enumerate(others[:args.instantiations]):
+                out.write('  ::n{}::Holder<::{}> held{};\n'.format(
+                    base, other, i))
+            for m in range(args.methods):
+                if others:
+                    other = '::' + others[m % len(others)]
+                    out.write('  {0} method{1}(const {0} &a, int b);\n'.format(
+                        other, m))
+                else:
+                    out.write('  int method{}(int a, int b);\n'.format(m))
+            out.write('};\n')
+
+        out.write('}} // namespace n{}\n'.format(h))
+
+
+def write_source(path, t, args, rng):
+    """Write translation unit `t` including some of the headers."""
+    headers = rng.sample(range(args.headers), min(args.includes, args.headers))
+    with open(path, 'w') as out:
+        for h in sorted(headers):
+            out.write('#include "{}"\n'.format(header_name(h)))
+        out.write('int f{}() {{\n'.format(t))
+        for h in sorted(headers):
+            out.write('  {{ ::{} *x = nullptr; (void)x; }}\n'.format(
+                class_name(h, rng.randrange(args.classes))))
+        out.write('  return 0;\n')
+        out.write('}\n')
+
+
+def generate(directory, args):
+    """Generate the code base into `directory`, returning its sources."""
+    rng = random.Random(args.seed)
+    directory = os.path.abspath(directory)
+    include = os.path.join(directory, 'include')
+    src = os.path.join(directory, 'src')
+    os.makedirs(include, exist_ok=True)
+    os.makedirs(src, exist_ok=True)
+
+    for h in range(args.headers):
+        write_header(os.path.join(include, header_name(h)), h, args, rng)
+
+    sources = []
+    commands = []
+    for t in range(args.tus):
+        source = os.path.join(src, 'tu{}.cpp'.format(t))
+        write_source(source, t, args, rng)
+        sources.append(source)
+        commands.append({
+            'directory': directory,
+            'file': source,
+            'arguments': ['c++', '-std=c++17', '-I' + include, '-c', source],
+        })
+
+    with open(os.path.join(directory, 'compile_commands.json'), 'w') as out:
+        json.dump(commands, out, indent=1)
+
+    return sources
+
+
+def add_arguments(parser):
+    """Add the knobs shaping the code base to `parser`."""
+    parser.add_argument('--tus', type=int, default=100,
+                        help='number of translation units')
+    parser.add_argument('--headers', type=int, default=100,
+                        help='number of headers')
+    parser.add_argument('--includes', type=int, default=10,
+                        help='headers included by each translation unit')
+    parser.add_argument('--classes', type=int, default=20,
+                        help='classes per header')
+    parser.add_argument('--depth', type=int, default=10,
+                        help='headers per hierarchy')
+    parser.add_argument('--width', type=int, default=2,
+                        help='bases of each class')
+    parser.add_argument('--instantiations', type=int, default=2,
+                        help='template instantiations owned by each class')
+    parser.add_argument('--methods', type=int, default=5,
+                        help='methods per class')
+    parser.add_argument('--seed', type=int, default=0,
+                        help='seed for all random choices')
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    add_arguments(parser)
+    parser.add_argument('directory', help='where to write the code base')
+    args = parser.parse_args()
+
+    generate(args.directory, args)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,68 @@
+#!/usr/bin/env python3
+"""Measure how extraction scales with the depth of class hierarchies.
+
+Generates a translation unit with a layered hierarchy: every level holds
+`--width` classes, each deriving from all classes of the level above it.
+With a width above one every level adds diamonds, which is where a walk
+revisiting shared bases degrades. For every requested depth the time to
+extract and report the most derived classes is printed.
+
+    % bench/hierarchy.py --umler path/to/umler --width 2 --depths 50 100 200
+"""
+
+import argparse
+import os
+import subprocess
+import sys
+import tempfile
+import time
+
+
+def generate(path, depth, width):
+    """Write a header-free translation unit with the hierarchy to `path`."""
+    with open(path, 'w') as out:
+        for level in range(depth):
+            for i in range(width):
+                bases = ', '.join('public virtual C{}_{}'.format(level - 1, j)
+                                  for j in range(width)) if level else ''
+                out.write('struct C{}_{}{} {{\n'.format(
+                    level, i, ' : ' + bases if bases else ''))
+                out.write('  int method{}_{}(int a);\n'.format(level, i))
+                out.write('};\n')
+        out.write('int main() {}\n')
+
+
+def run(umler, source, depth, width):
+    """Extract the most derived classes, returning the wall time."""
+    classes = ['-c=C{}_{}'.format(depth - 1, i) for i in range(width)]
+    command = [umler] + classes + [source, '--', '-std=c++11']
+
+    start = time.perf_counter()
+    subprocess.run(command, check=True, stdout=subprocess.DEVNULL)
+    return time.perf_counter() - start
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('--umler', default='umler', help='umler binary')
+    parser.add_argument('--width', type=int, default=1,
+                        help='classes per hierarchy level')
+    parser.add_argument('--depths', type=int, nargs='+',
+                        default=[25, 50, 100, 200, 400],
+                        help='hierarchy depths to measure')
+    args = parser.parse_args()
+
+    print('{:>8} {:>8} {:>8} {:>10}'.format('depth', 'width', 'classes',
+                                            'seconds'))
+    with tempfile.TemporaryDirectory() as directory:
+        for depth in args.depths:
+            source = os.path.join(directory, 'hierarchy.cpp')
+            generate(source, depth, args.width)
+            seconds = run(args.umler, source, depth, args.width)
+            print('{:>8} {:>8} {:>8} {:>10.3f}'.format(
+                depth, args.width, depth * args.width, seconds))
+            sys.stdout.flush()
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,148 @@
+#!/usr/bin/env python3
+"""Measure umler end to end on synthetic workloads.
+
+Every workload is a code base generated by `generate.py` with fixed knobs and
+seed. For each workload umler extracts all translation units into a fresh
+database and reports all classes; the wall time, throughput, time spent in
+translation units summed over all threads, writing and reporting as given by
+`-stats`, peak RSS and database size are printed, and with `--json` saved for
+comparison between builds. With `-j` other than 1 the translation unit time
+exceeds the wall time spent extracting.
+
+    % bench/run.py --umler path/to/umler --workloads small medium -j 0
+"""
+
+import argparse
+import json
+import os
+import re
+import subprocess
+import sys
+import time
+
+import generate
+
+WORKLOADS = {
+    'small': dict(tus=20, headers=20, includes=5, classes=10, depth=5,
+                  width=2, instantiations=2, methods=5),
+    'medium': dict(tus=100, headers=100, includes=10, classes=20, depth=6,
+                   width=2, instantiations=4, methods=8),
+    'large': dict(tus=400, headers=400, includes=10, classes=25, depth=6,
+                  width=2, instantiations=4, methods=10),
+    'templates': dict(tus=100, headers=50, includes=10, classes=20, depth=10,
+                      width=1, instantiations=16, methods=2),
+    'deep': dict(tus=50, headers=200, includes=5, classes=10, depth=200,
+                 width=1, instantiations=1, methods=2),
+}
+
+
+def stats(output):
+    """Parse phase times and counters from the `-stats` summary."""
+    phases = {}
+    counters = {}
+    for line in output.splitlines():
+        match = re.match(r'^\s*(\S.*?)\s+(\d+)\s+(\d+\.\d+)$', line)
+        if match:
+            phases[match.group(1)] = float(match.group(3))
+            continue
+        match = re.match(r'^(\S.*?)\s+(\d+)$', line)
+        if match:
+            counters[match.group(1)] = int(match.group(2))
+    return phases, counters
+
+
+def run(umler, directory, sources, jobs):
+    """Extract and report `sources` into a fresh database."""
+    db = os.path.join(directory, 'umler.sqlite')
+    for suffix in ['', '-wal', '-shm', '-journal']:
+        if os.path.exists(db + suffix):
+            os.remove(db + suffix)
+
+    command = [umler, '-p', directory, '-d', db, '-j', str(jobs), '-stats']
+    command += sources
+
+    start = time.perf_counter()
+    process = subprocess.Popen(command, stdout=subprocess.DEVNULL,
+                               stderr=subprocess.PIPE,
+                               universal_newlines=True)
+    output = process.stderr.read()
+    # wait4 gives the resource usage of this child alone
+    _, status, usage = os.wait4(process.pid, 0)
+    seconds = time.perf_counter() - start
+    if os.WIFSIGNALED(status):
+        process.returncode = -os.WTERMSIG(status)
+    else:
+        process.returncode = os.WEXITSTATUS(status)
+    if process.returncode:
+        sys.stderr.write(output)
+        raise subprocess.CalledProcessError(process.returncode, command)
+
+    phases, counters = stats(output)
+    size = sum(os.path.getsize(db + suffix) for suffix in ['', '-wal']
+               if os.path.exists(db + suffix))
+    classes = counters.get('classes recorded', 0)
+
+    return {
+        'seconds': seconds,
+        'tus_per_second': len(sources) / seconds,
+        'classes': classes,
+        'classes_per_second': classes / seconds,
+        # summed over threads, not wall time
+        'tu_thread_seconds': phases.get('translation unit', 0.0),
+        'write_seconds': phases.get('write', 0.0),
+        'report_seconds': phases.get('report', 0.0),
+        # ru_maxrss is in KiB on Linux
+        'peak_rss_mib': usage.ru_maxrss / 1024,
+        'db_mib': size / 2**20,
+    }
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('--umler', default='umler', help='umler binary')
+    parser.add_argument('--workdir', default='umler-bench',
+                        help='where to generate the workloads')
+    parser.add_argument('--workloads', nargs='+', default=['small', 'medium'],
+                        choices=sorted(WORKLOADS), help='workloads to run')
+    parser.add_argument('-j', '--jobs', type=int, default=1,
+                        help='umler -j setting')
+    parser.add_argument('--repeat', type=int, default=1,
+                        help='runs per workload; the fastest is reported')
+    parser.add_argument('--json', help='also write the results to this file')
+    args = parser.parse_args()
+
+    columns = [('workload', '{:>10}'), ('tus', '{:>6}'),
+               ('classes', '{:>8}'), ('seconds', '{:>9.3f}'),
+               ('tu/s', '{:>8.1f}'), ('classes/s', '{:>10.1f}'),
+               ('tu thread s', '{:>12.3f}'), ('write', '{:>8.3f}'),
+               ('report', '{:>8.3f}'), ('rss MiB', '{:>8.1f}'),
+               ('db MiB', '{:>8.1f}')]
+    print(' '.join(re.sub(r'\.\d+f', '', f).format(name)
+                   for name, f in columns))
+
+    results = {}
+    for name in args.workloads:
+        knobs = argparse.Namespace(seed=0, **WORKLOADS[name])
+        directory = os.path.abspath(os.path.join(args.workdir, name))
+        sources = generate.generate(directory, knobs)
+
+        result = min((run(args.umler, directory, sources, args.jobs)
+                      for _ in range(args.repeat)),
+                     key=lambda r: r['seconds'])
+        results[name] = dict(WORKLOADS[name], **result)
+
+        values = [name, knobs.tus, result['classes'], result['seconds'],
+                  result['tus_per_second'], result['classes_per_second'],
+                  result['tu_thread_seconds'], result['write_seconds'],
+                  result['report_seconds'], result['peak_rss_mib'],
+                  result['db_mib']]
+        print(' '.join(f.format(v) for (_, f), v in zip(columns, values)))
+        sys.stdout.flush()
+
+    if args.json:
+        with open(args.json, 'w') as out:
+            json.dump(results, out, indent=1, sort_keys=True)
+
+
+if __name__ == '__main__':
+    main()